@@ -10,6 +10,8 @@
 
 #include "client_cxt.h"
 #include "helping_hand.h"
+#include "plan.h"
+#include "profile.h"
 #include "tui.h"
 #include "uplink.h"
 
@@ -40,22 +42,112 @@ parse_int(const char *string, int *value) {
     return 0;
 }
 
+// HOST or HOST:PORT, port 0 means the one from --tcp-port
+static int
+parse_endpoint(const char *str, tcp_endp *out) {
+    char host[32] = {0};
+    strncpy(host, str, sizeof(host) - 1);
+
+    out->tcp_port = 0;
+
+    char *colon = strchr(host, ':');
+    if (colon) {
+        *colon = '\0';
+        if (parse_int(colon + 1, &out->tcp_port) < 0) {
+            return -1;
+        } else if (out->tcp_port < 1 || out->tcp_port > 65535) {
+            printf("'%s': tcp port must be between 1 and 65535\n", str);
+            return -1;
+        }
+    }
+
+    if (!validate_ip(host)) {
+        printf("'%s': Invalid IP Address\n", str);
+        return -1;
+    }
+    strncpy(out->host, host, sizeof(out->host) - 1);
+
+    return 0;
+}
+
+static int
+add_fleet_endpoint(global_t *global, const char *str) {
+    if (global->fleet_len >= FLEET_MAX_ENDPOINTS) {
+        printf("too many fleet endpoints, max: %d\n", FLEET_MAX_ENDPOINTS);
+        return -1;
+    }
+
+    tcp_endp endp = {0};
+    if (parse_endpoint(str, &endp) < 0) {
+        return -1;
+    }
+
+    tcp_endp *fleet = realloc(global->fleet, (global->fleet_len + 1) * sizeof(tcp_endp));
+    if (!fleet) {
+        printf("failed to allocate fleet endpoint\n");
+        return -1;
+    }
+
+    fleet[global->fleet_len++] = endp;
+    global->fleet              = fleet;
+
+    return 0;
+}
+
+// one endpoint per line, everything after '#' is a comment
+static int
+load_fleet(global_t *global, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("'%s': %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    char line[128] = {0};
+    int  line_no   = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+
+        char *endp = strtok(line, " \t\r\n");
+        if (!endp) {
+            continue;
+        }
+
+        if (add_fleet_endpoint(global, endp) < 0) {
+            printf("%s:%d: invalid endpoint\n", path, line_no);
+            fclose(f);
+            return -1;
+        }
+    }
+
+    fclose(f);
+    return 0;
+}
+
 static void
 help(const char *progname) {
     const char *help_message =
-      "Usage: %s [-h|--usage] tcp       HOST   [OPTIONS] [WRITE VALUES]\n"
-      "   or: %s [-h|--usage] rtu|ascii DEVICE [OPTIONS] [WRITE VALUES]\n"
-      "Send Modbus TCP|RTU|ASCII request to remote slave device.\n"
+      "Usage: %s [-h|--usage] tcp|udp|rtu-tcp HOST   [OPTIONS] [WRITE VALUES]\n"
+      "   or: %s [-h|--usage] rtu|ascii       DEVICE [OPTIONS] [WRITE VALUES]\n"
+      "Send Modbus TCP|UDP|RTU|ASCII request to remote slave device.\n"
+      "rtu-tcp sends RTU frames over raw TCP, the way serial to Ethernet converters do.\n"
       "WRITE VALUES can be in decimal or hexidecimal, like so:\n"
       " decimal:     0 2 5 11 23 ...\n"
       " hexidecimal: 0x0 0x2 0x5 0xB 0x17 ...\n"
       "For functions 1-2, 15: WRITE VALUES are binary values (0 or 1).\n"
       "For other functions:   WRITE VALUES are 16-bit integers.\n\n"
-      " TCP options:\n"
-      "  -t, --tcp-port=NUM                       TCP port of Modbus TCP slave (1-65535).\n"
-      "                                           Default: 502.\n\n"
+      " Network options:\n"
+      "  -t, --tcp-port=NUM                       TCP or UDP port of slave (1-65535).\n"
+      "                                           Default: 502.\n"
+      "      --timestamping                       Measure request to response wire latency with kernel socket\n"
+      "                                           timestamps (hardware ones if NIC has them switched on).\n\n"
       " Serial options:\n"
-      "  -b, --baudrate=NUM                       Transmission speed (1200-921600 bps).\n"
+      "  -b, --baudrate=NUM                       Transmission speed (50-4000000 bps), any rate driver supports.\n"
       "                                           Default: 115200.\n"
       "  -p, --parity=N|O|E                       Parity Bit (None, Odd, Even).\n"
       "                                           Default: None.\n"
@@ -63,6 +155,7 @@ help(const char *progname) {
       "                                           Default: 8.\n"
       "      --stop-bits=1|2                      Number of stop bits in frame (1-2).\n"
       "                                           Default: 1.\n"
+      "      --rtu-timing                         Delimit RTU frames by t3.5 silence and report inter-char gaps.\n"
       " Protocol options:\n"
       "  -s, --slave-start=NUM                    Slave (Unit) ID range start (1-255).\n"
       "                                           Default: 1.\n"
@@ -77,14 +170,58 @@ help(const char *progname) {
       "  -W, --write-addr=NUM                     Write address (in remote slave device) (0-65535).\n"
       "                                           Default: 0.\n"
       "  -w, --write-count=NUM                    Write count (max count depends on function).\n"
-      "                                           Default: 1.\n\n"
+      "                                           Default: 1.\n"
+      "      --plan=FILE                          Send mix of requests listed in FILE instead of the one above.\n"
+      "                                           Step per line of key=value: fc, uid, addr, count\n"
+      "                                           (raddr, rcount, waddr, wcount for fc 23), data=V,V,...|random,\n"
+      "                                           repeat (in a row), weight (steps are picked at random by it).\n"
+      "                                           Line 'group name=NAME period=MS' starts scan group, its steps\n"
+      "                                           are polled every period, each group on its own.\n"
+      "                                           Line 'read fc=1..4 uid=N gap=N addr=0-9,15,...' lists items\n"
+      "                                           wanted, they are read by as few requests as possible, each\n"
+      "                                           one may read up to gap unwanted items between wanted ones.\n"
+      "      --discover=FILE                      On start find all slaves (uid 1-247) and address ranges of fc\n"
+      "                                           1-4 they have, write them to FILE as --plan of read lines.\n\n"
       " Miscellaneous options:\n"
       "  -q, --response_timeout=NUM               Response timeout for incoming modbus packet.\n"
       "                                           Default: 100.\n"
+      "      --adaptive-timeout                   Wait for response of every slave as long as its smoothed\n"
+      "                                           response time plus variance (as TCP RTO), but no longer\n"
+      "                                           than --response_timeout.\n"
+      "      --rto-min=NUM                        Floor of adaptive response timeout (ms) (1-10000).\n"
+      "                                           Default: 5.\n"
+      "      --histogram=FILE                     Write response time histogram (percentile distribution of\n"
+      "                                           hdr histogram) to FILE at the end of every run or fire sequence,\n"
+      "                                           corrected for coordinated omission to FILE.corrected.\n"
+      "                                           Timed out requests count in corrected one as answered\n"
+      "                                           when they were given up on.\n"
       "  -l, --random                             Use random bytes as data for write commands.\n"
       "                                           Default: No.\n"
       "  -T, --timeout=NUM                        Timeout between requests (ms) (0-600000).\n"
-      "                                           Default: 1000.\n\n"
+      "                                           Default: 1000.\n"
+      "  -P, --pipeline=NUM                       TCP requests kept in flight at once (1-256).\n"
+      "                                           Default: 1.\n"
+      "  -C, --connections=NUM                    TCP connections to open for load generation (1-4096).\n"
+      "                                           Default: 1.\n"
+      "      --workers=NUM                        Threads to spread load generator connections over (1-64).\n"
+      "                                           Default: 1.\n"
+      "      --backend=NAME                       Load generator i/o: epoll or io_uring (implies load generator).\n"
+      "                                           Default: epoll.\n"
+      "      --standby                            Keep a spare TCP connection open to fail over to instantly.\n\n"
+      " Pacing options (default: --timeout of pause after every request):\n"
+      "      --rate=NUM                           Open loop: send NUM requests per second over all connections,\n"
+      "                                           whatever response time is (1-10000000).\n"
+      "      --poisson                            With --rate or --profile: Poisson arrivals instead of fixed gaps.\n"
+      "      --profile=SPEC                       Open loop with rate changing over the run, which stops at its end.\n"
+      "                                           SPEC is comma separated phases (rates in req/s, time in s):\n"
+      "                                           ramp:FROM-TO:SECS, hold:RATE:SECS, spike:RATE:SECS,\n"
+      "                                           step:FROM+INCxCOUNT:SECS. Results are logged per phase.\n"
+      "      --closed-loop                        Send next request as soon as one in flight is done,\n"
+      "                                           --pipeline requests in flight per connection.\n\n"
+      " Fleet options (poll HOST together with other endpoints, --connections is per endpoint):\n"
+      "  -E, --endpoint=HOST[:PORT]               Add endpoint to fleet, can be repeated.\n"
+      "                                           Default port: --tcp-port.\n"
+      "      --fleet=FILE                         Add endpoints listed in FILE, one HOST[:PORT] per line.\n\n"
       "  --csv                                    Log traffic in .csv files\n\n"
       "  -h, --help                               Give this help list\n"
       "      --usage                              Give a short usage message\n";
@@ -121,6 +258,24 @@ handle_startup_args(int argc, char **argv, global_t *global) {
           {"write-count", OPT_ARG_REQUIRED, 0, 'w'},
           {"response-timeout", OPT_ARG_REQUIRED, 0, 'q'},
           {"timeout", OPT_ARG_REQUIRED, 0, 'T'},
+          {"pipeline", OPT_ARG_REQUIRED, 0, 'P'},
+          {"connections", OPT_ARG_REQUIRED, 0, 'C'},
+          {"workers", OPT_ARG_REQUIRED, 0, 0},
+          {"endpoint", OPT_ARG_REQUIRED, 0, 'E'},
+          {"fleet", OPT_ARG_REQUIRED, 0, 0},
+          {"backend", OPT_ARG_REQUIRED, 0, 0},
+          {"rtu-timing", OPT_ARG_NONE, 0, 0},
+          {"standby", OPT_ARG_NONE, 0, 0},
+          {"adaptive-timeout", OPT_ARG_NONE, 0, 0},
+          {"rto-min", OPT_ARG_REQUIRED, 0, 0},
+          {"timestamping", OPT_ARG_NONE, 0, 0},
+          {"rate", OPT_ARG_REQUIRED, 0, 0},
+          {"poisson", OPT_ARG_NONE, 0, 0},
+          {"closed-loop", OPT_ARG_NONE, 0, 0},
+          {"profile", OPT_ARG_REQUIRED, 0, 0},
+          {"plan", OPT_ARG_REQUIRED, 0, 0},
+          {"discover", OPT_ARG_REQUIRED, 0, 0},
+          {"histogram", OPT_ARG_REQUIRED, 0, 0},
           // common
           {"csv", OPT_ARG_NONE, 0, 0},
           {0},
@@ -131,7 +286,7 @@ handle_startup_args(int argc, char **argv, global_t *global) {
          * a:  - argument with value
          * a:: - argument with optional value, will return null w/o value
          */
-        c = getopt_long(argc, argv, "t:b:p:ls:e:f:R:r:W:w:q:T:", long_options, &option_index);
+        c = getopt_long(argc, argv, "t:b:p:ls:e:f:R:r:W:w:q:T:P:C:E:", long_options, &option_index);
         if (c == -1) {
             break;
         }
@@ -150,6 +305,69 @@ handle_startup_args(int argc, char **argv, global_t *global) {
                 }
             } else if (strcmp(long_options[option_index].name, "csv") == 0) {
                 global->use_csv_log = TRUE;
+            } else if (strcmp(long_options[option_index].name, "rtu-timing") == 0) {
+                global->rtu_timing = TRUE;
+            } else if (strcmp(long_options[option_index].name, "standby") == 0) {
+                global->standby = TRUE;
+            } else if (strcmp(long_options[option_index].name, "adaptive-timeout") == 0) {
+                global->adaptive_timeout = TRUE;
+            } else if (strcmp(long_options[option_index].name, "rto-min") == 0) {
+                if (parse_int(optarg, &global->rto_min) < 0) {
+                    return RC_ERROR;
+                } else if (global->rto_min < 1 || global->rto_min > 10000) {
+                    printf("invalid rto-min value: '%s', allowed: 1-10000\n", optarg);
+                    return RC_ERROR;
+                }
+            } else if (strcmp(long_options[option_index].name, "timestamping") == 0) {
+                global->timestamping = TRUE;
+            } else if (strcmp(long_options[option_index].name, "rate") == 0) {
+                if (parse_int(optarg, &global->rate) < 0) {
+                    return RC_ERROR;
+                } else if (global->rate < 1 || global->rate > 10000000) {
+                    printf("invalid rate value: '%s', allowed: 1-10000000\n", optarg);
+                    return RC_ERROR;
+                }
+                if (global->sched_mode == SCHED_INTERVAL) {
+                    global->sched_mode = SCHED_RATE;
+                }
+            } else if (strcmp(long_options[option_index].name, "poisson") == 0) {
+                global->sched_mode = SCHED_POISSON;
+            } else if (strcmp(long_options[option_index].name, "closed-loop") == 0) {
+                global->sched_mode = SCHED_CLOSED;
+            } else if (strcmp(long_options[option_index].name, "profile") == 0) {
+                global->profile = profile_parse(optarg);
+                if (!global->profile) {
+                    return RC_ERROR;
+                }
+            } else if (strcmp(long_options[option_index].name, "workers") == 0) {
+                if (parse_int(optarg, &global->workers) < 0) {
+                    return RC_ERROR;
+                } else if (global->workers < 1 || global->workers > 64) {
+                    printf("invalid workers value: '%s', allowed: 1-64\n", optarg);
+                    return RC_ERROR;
+                }
+            } else if (strcmp(long_options[option_index].name, "backend") == 0) {
+                if (strcmp(optarg, "epoll") == 0) {
+                    global->backend = IO_BACKEND_EPOLL;
+                } else if (strcmp(optarg, "io_uring") == 0) {
+                    global->backend = IO_BACKEND_URING;
+                } else {
+                    printf("invalid backend: '%s', allowed: epoll, io_uring\n", optarg);
+                    return RC_ERROR;
+                }
+            } else if (strcmp(long_options[option_index].name, "discover") == 0) {
+                global->discover = optarg;
+            } else if (strcmp(long_options[option_index].name, "histogram") == 0) {
+                global->histogram = optarg;
+            } else if (strcmp(long_options[option_index].name, "plan") == 0) {
+                global->plan = plan_load(optarg);
+                if (!global->plan) {
+                    return RC_ERROR;
+                }
+            } else if (strcmp(long_options[option_index].name, "fleet") == 0) {
+                if (load_fleet(global, optarg) < 0) {
+                    return RC_ERROR;
+                }
             }
             break;
 
@@ -162,6 +380,9 @@ handle_startup_args(int argc, char **argv, global_t *global) {
         case 'b':
             if (parse_int(optarg, &global->sconf.baud) < 0) {
                 return RC_ERROR;
+            } else if (global->sconf.baud < 50 || global->sconf.baud > 4000000) {
+                printf("invalid baudrate: '%s', allowed: 50-4000000\n", optarg);
+                return RC_ERROR;
             }
             break;
 
@@ -231,11 +452,77 @@ handle_startup_args(int argc, char **argv, global_t *global) {
             }
             break;
 
+        case 'C':
+            if (parse_int(optarg, &global->connections) < 0) {
+                return RC_ERROR;
+            } else if (global->connections < 1 || global->connections > 4096) {
+                printf("invalid connections value: '%s', allowed: 1-4096\n", optarg);
+                return RC_ERROR;
+            }
+            break;
+
+        case 'E':
+            if (add_fleet_endpoint(global, optarg) < 0) {
+                return RC_ERROR;
+            }
+            break;
+
+        case 'P':
+            if (parse_int(optarg, &global->pipeline) < 0) {
+                return RC_ERROR;
+            } else if (global->pipeline < 1 || global->pipeline > 256) {
+                printf("invalid pipeline value: '%s', allowed: 1-256\n", optarg);
+                return RC_ERROR;
+            }
+            break;
+
         case 'h': help(""); return RC_FAIL;
         default: help(""); return RC_FAIL;
         }
     }
 
+    // fleet endpoints without port use the same port as main one
+    for (int k = 0; k < global->fleet_len; k++) {
+        if (!global->fleet[k].tcp_port) {
+            global->fleet[k].tcp_port = global->tcp_endp.tcp_port;
+        }
+    }
+
+    if (global->fleet_len && (global->cxt.protocol == MB_PROTOCOL_RTU || global->cxt.protocol == MB_PROTOCOL_ASCII)) {
+        printf("fleet mode is available only for tcp, udp and rtu-tcp\n");
+        return RC_ERROR;
+    }
+
+    // profile is open loop whose rate starts at the first phase
+    if (global->profile) {
+        if (global->rate || global->sched_mode == SCHED_CLOSED) {
+            printf("--profile excludes --rate and --closed-loop\n");
+            return RC_ERROR;
+        } else if (global->plan && global->plan->ngroups) {
+            printf("--plan with scan groups can't be paced by --profile\n");
+            return RC_ERROR;
+        }
+        global->rate       = global->profile->phases[0].from;
+        global->sched_mode = global->sched_mode == SCHED_POISSON ? SCHED_POISSON : SCHED_RATE;
+    }
+
+    // scan groups pace themselves
+    if (global->plan && global->plan->ngroups) {
+        if (global->sched_mode != SCHED_INTERVAL) {
+            printf("--plan with scan groups can't be paced by --rate or --closed-loop\n");
+            return RC_ERROR;
+        }
+        global->sched_mode = SCHED_SCAN;
+    }
+
+    if (global->sched_mode == SCHED_POISSON && !global->rate) {
+        printf("--poisson needs --rate\n");
+        return RC_ERROR;
+    } else if (global->sched_mode == SCHED_CLOSED && global->rate) {
+        printf("--closed-loop and --rate exclude each other\n");
+        return RC_ERROR;
+    }
+
     int j = 0;
     int i = parsed_opts + 3; // progname + mode + endpoint
 
@@ -269,8 +556,14 @@ init_client(int argc, char **argv, global_t *global) {
     global->cxt.wcount   = 1;
 
     global->response_timeout = 100;
+    global->rto_min          = 5;
     global->random           = 0;
     global->timeout          = 1000;
+    global->pipeline         = 1;
+    global->connections      = 1;
+    global->workers          = 1;
+    global->backend          = IO_BACKEND_EPOLL;
+    global->sched_mode       = SCHED_INTERVAL;
 
     const char *progname = argv[0];
     if (argc < 3) {
@@ -287,14 +580,20 @@ init_client(int argc, char **argv, global_t *global) {
         global->cxt.protocol = MB_PROTOCOL_ASCII;
     } else if (strcmp(mode, "tcp") == 0) {
         global->cxt.protocol = MB_PROTOCOL_TCP;
+    } else if (strcmp(mode, "udp") == 0) {
+        global->cxt.protocol = MB_PROTOCOL_UDP;
+    } else if (strcmp(mode, "rtu-tcp") == 0) {
+        global->cxt.protocol = MB_PROTOCOL_RTU_TCP;
     } else {
         return RC_FAIL;
     }
 
     switch (global->cxt.protocol) {
     case MB_PROTOCOL_TCP:
+    case MB_PROTOCOL_UDP:
+    case MB_PROTOCOL_RTU_TCP:
         if (!validate_ip(endp)) {
-            printf("TCP: Invalid IP Address\n");
+            printf("%s: Invalid IP Address\n", mode);
             return RC_FAIL;
         }
 
@@ -1,13 +1,26 @@
 #ifndef CLIENT_CXT_H
 #define CLIENT_CXT_H
 
+#include "hist.h"
+#include "rto.h"
+#include "sched.h"
+#include "stats.h"
 #include "types.h"
 
 #define WD_MAX_LEN 125 // maximum ammount of custom coils/regs data to write
 
+#define FLEET_MAX_ENDPOINTS 4096
+
+// how load generator workers do tcp i/o
+typedef enum io_backend {
+    IO_BACKEND_EPOLL,
+    IO_BACKEND_URING,
+} io_backend_t;
+
 typedef struct {
     char device[32];
     int  baud;
+    int  baud_actual; // rate driver applied, 0 until port is opened
     char parity;
     int  data_bits;
     int  stop_bits;
@@ -18,6 +31,28 @@ typedef struct {
     int  tcp_port;
 } tcp_endp;
 
+// request compiled once from settings, every next request is patched from it, see request.c
+typedef struct req_template {
+    u32           gen; // settings generation template was compiled at
+    mb_protocol_t protocol;
+    fc_t          fc;
+    u8            uid; // uid adu was compiled for
+
+    u8 pdu_len;
+    u8 pdu[MB_MAX_PDU_LEN];
+
+    int adu_len; // 0 - not compiled yet
+    u8  adu[MB_MAX_ADU_LEN];
+} req_template_t;
+
+// how far connection went through --plan, see plan.c
+typedef struct plan_cursor {
+    u32 step; // step requests are taken from
+    u32 next; // ordered plan: step after current one
+    u32 left; // requests of current step left to send (scan: of current group)
+    u64 rand; // weighted plan: xorshift state, 0 - not seeded yet
+} plan_cursor_t;
+
 typedef struct {
     mb_protocol_t protocol;
     mb_protocol_t last_run_was_on;
@@ -30,43 +65,70 @@ typedef struct {
 
     u16 wdata[WD_MAX_LEN];
 
+    u8  current_uid; // next uid in sequence
     u16 tid;
     int fd;
-} client_cxt_t;
 
-typedef struct statistic {
-    u32 requests;
-    u32 success;
-    u32 timeouts;
-    u32 fails;
-} statistic_t;
+    req_template_t tmpl;
+    plan_cursor_t  plan;
+    rto_t          rto[256]; // --adaptive-timeout: response time estimate per uid
+    rto_t          rto_link; // and over all uids answering on this connection
+} client_cxt_t;
 
 typedef struct global {
     serial_cfg sconf;
     tcp_endp   tcp_endp;
 
+    const char     *discover;  // --discover: map the bus into this file first, NULL - don't
+    const char     *histogram; // --histogram: dump response time histogram here when run is over, NULL - don't
+    struct profile *profile;  // --profile: open loop rate changing over the run, NULL - fixed --rate
+    struct plan    *plan;     // --plan: mix of requests to send instead of the one from settings, NULL - none
+
+    // fleet mode: endpoints polled concurrently together with tcp_endp
+    tcp_endp *fleet;
+    int       fleet_len;
+
     client_cxt_t cxt;
 
     statistic_t stats;
+    hist_t      latency;   // response time of main loop requests
+    hist_t      corrected; // and the same corrected for coordinated omission
 
     u8 use_csv_log;
+    u8 rtu_timing;   // delimit rtu frames by t3.5 of silence instead of computed length
+    u8 timestamping; // measure wire latency with kernel socket timestamps
 
     u8  sequence_uid; // if 0 - use just single slave_id_start, if 1 - sequence from start to end
-    u8  current_uid;
     int slave_id_start;
     int slave_id_end;
     int response_timeout; // ms
+    u8  adaptive_timeout; // response timeout of every uid follows its response time, --response_timeout is ceiling
+    int rto_min;          // ms, floor of adaptive timeout
+    int pipeline;         // tcp requests kept in flight, 1 - wait for every response before next request
+    int connections;      // tcp connections opened by load generator
+    int workers;          // threads load generator connections are spread over
+
+    io_backend_t backend;
+    u8           standby; // keep warm spare tcp connection per connection for failover
 
     u8  running;
     int timeout; // ms
     int random;
 
+    sched_mode_t sched_mode; // how requests are paced
+    int          rate;       // open loop: requests per second over all connections
+    sched_t      sched;      // pacing of main loop, timing of the whole run for load generator
+
+    u32 cfg_gen; // bumped whenever settings requests are built from change
+
     u32 rfire_count;   // requests ordered to fire in sequence
     u32 rfire_current; // current request in fire sequence
 
-    u64 time_start;
+    u64 time_start; // us, monotonic
 } global_t;
 
+extern global_t globals;
+
 int init_client(int argc, char **argv, global_t *global);
 
 #endif
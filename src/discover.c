@@ -0,0 +1,428 @@
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "discover.h"
+#include "helping_hand.h"
+#include "mb_base.h"
+#include "rx_ring.h"
+#include "tui.h"
+#include "uplink.h"
+
+typedef enum probe_res {
+    PROBE_PENDING,
+    PROBE_OK,
+    PROBE_EXCEPTION,
+    PROBE_SILENT, // timed out or gateway says slave is not there
+} probe_res_t;
+
+// one read request of discovery
+typedef struct probe {
+    u8   uid;
+    fc_t fc;
+    u16  addr;
+    u16  count;
+
+    u8  res;
+    u8  ex; // exception code
+    u16 tid;
+    u64 sent_us;
+    u64 deadline_us;
+} probe_t;
+
+typedef struct disc {
+    int           fd;
+    mb_protocol_t protocol;
+    int           window;
+    rx_ring_t     rx;
+
+    probe_t *fly[DISCOVER_WINDOW]; // probes in flight
+    int      nfly;
+
+    // response times, timeouts are cut to them as soon as anyone answers
+    rto_t rto[256];
+    rto_t link;
+
+    u32 sent;
+    int lost; // connection dropped, nothing more can be done
+} disc_t;
+
+// ======================================================================================
+// Probing
+// ======================================================================================
+
+// time response takes on the wire, on serial line it is way longer than slave's turnaround
+static u32
+disc_wire_us(disc_t *d, probe_t *p) {
+    if (uplink_kind(d->protocol) != UPLINK_SERIAL) {
+        return 0;
+    }
+
+    func_cxt_t fcxt = {.fc = p->fc, .raddress = p->addr, .rcount = p->count};
+    return client_get_expected_rsp_adu_len(d->protocol, &fcxt) * serial_char_us(&globals.sconf);
+}
+
+// slave which answered waits for its own estimate, unknown one - twice as long as others take,
+// until anyone answers there is nothing to go by but --response_timeout
+static u32
+disc_timeout_us(disc_t *d, probe_t *p) {
+    u32 ceil = (u32)globals.response_timeout * 1000;
+    u32 base = ceil;
+
+    if (d->rto[p->uid].samples) {
+        base = d->rto[p->uid].rto_us;
+    } else if (d->link.samples) {
+        base = MIN_VAL(2 * d->link.rto_us, ceil);
+    }
+
+    return base + disc_wire_us(d, p);
+}
+
+static int
+disc_send(disc_t *d, probe_t *p) {
+    frame_t    frame = {0};
+    func_cxt_t fcxt  = {.fc = p->fc, .raddress = p->addr, .rcount = p->count};
+
+    frame.protocol = d->protocol;
+    frame.fc       = p->fc;
+    frame.uid      = p->uid;
+    frame.tid      = ++globals.cxt.tid;
+    frame.pdu_len  = build_pdu(frame.pdu, NULL, fcxt);
+
+    u8  adu[MB_MAX_ADU_LEN] = {0};
+    int adu_len             = build_adu(adu, &frame);
+
+    // without tid only one probe is in flight, whatever is left belongs to the older ones
+    if (mb_framing(d->protocol) != MB_PROTOCOL_TCP) {
+        rx_reset(&d->rx);
+        if (uplink_kind(d->protocol) == UPLINK_SERIAL) {
+            tcflush(d->fd, TCIFLUSH);
+        }
+    }
+
+    if (write(d->fd, adu, adu_len) != adu_len) {
+        log_linef("! discovery: failed to send: %s", strerror(errno));
+        d->lost = TRUE;
+        return RC_FAIL;
+    }
+
+    p->tid         = frame.tid;
+    p->sent_us     = now_us();
+    p->deadline_us = p->sent_us + disc_timeout_us(d, p);
+    p->res         = PROBE_PENDING;
+    d->fly[d->nfly++] = p;
+    d->sent++;
+    return RC_SUCCESS;
+}
+
+static void
+disc_land(disc_t *d, int i, probe_res_t res) {
+    d->fly[i]->res = res;
+    d->fly[i]      = d->fly[--d->nfly];
+}
+
+static void
+disc_take(disc_t *d, u8 *adu, int adu_len) {
+    if (mb_is_adu_valid(d->protocol, adu, adu_len) != MB_VALIDATION_ERROR_OK) {
+        return;
+    }
+
+    frame_t rsp = {0};
+    mb_extract_frame(d->protocol, adu, adu_len, &rsp);
+
+    int tcp = mb_framing(d->protocol) == MB_PROTOCOL_TCP;
+    for (int i = 0; i < d->nfly; i++) {
+        probe_t *p = d->fly[i];
+        if ((tcp && p->tid != rsp.tid) || p->uid != rsp.uid || (rsp.pdu[0] & 0x7F) != p->fc) {
+            continue;
+        }
+
+        // turnaround of slave, wire time is added to every timeout on its own
+        u32 rtt  = now_us() - p->sent_us;
+        u32 wire = disc_wire_us(d, p);
+        rto_sample(&d->rto[p->uid], &d->link, rtt > wire ? rtt - wire : 0);
+
+        if (!(rsp.pdu[0] & 0x80)) {
+            disc_land(d, i, PROBE_OK);
+        } else if (rsp.pdu[1] == MB_EX_GATEWAY_PATH || rsp.pdu[1] == MB_EX_GATEWAY_TARGET) {
+            disc_land(d, i, PROBE_SILENT);
+        } else {
+            p->ex = rsp.pdu[1];
+            disc_land(d, i, PROBE_EXCEPTION);
+        }
+        return;
+    }
+}
+
+// run all probes, as many in flight as protocol allows
+static void
+disc_run(disc_t *d, probe_t *probes, int n) {
+    int next = 0;
+
+    while (!d->lost && (next < n || d->nfly)) {
+        while (next < n && d->nfly < d->window) {
+            if (!disc_send(d, &probes[next++])) {
+                return;
+            }
+        }
+
+        u64 deadline = d->fly[0]->deadline_us;
+        for (int i = 1; i < d->nfly; i++) {
+            deadline = MIN_VAL(deadline, d->fly[i]->deadline_us);
+        }
+
+        int rc = uplink_wait_readable(d->fd, deadline);
+        if (rc == RC_SUCCESS) {
+            int room = 0;
+            u8 *dst  = rx_write_ptr(&d->rx, &room);
+            int add  = read(d->fd, dst, room);
+            if (add == 0 || (add < 0 && errno != EAGAIN && errno != EINTR)) {
+                log_linef("! discovery: connection lost");
+                d->lost = TRUE;
+                return;
+            } else if (add > 0) {
+                rx_produce(&d->rx, add);
+            }
+
+            u8  adu[MB_MAX_ADU_LEN];
+            int adu_len = 0;
+            while ((adu_len = rx_next_adu(&d->rx, d->protocol, MB_DIR_RESPONSE, adu)) != 0) {
+                if (adu_len > 0) {
+                    disc_take(d, adu, adu_len);
+                }
+            }
+        } else if (rc == RC_ERROR) {
+            log_linef("! discovery: failed to wait for response: %s", strerror(errno));
+            d->lost = TRUE;
+            return;
+        }
+
+        u64 now = now_us();
+        for (int i = d->nfly - 1; i >= 0; i--) {
+            if (d->fly[i]->deadline_us <= now) {
+                rto_expired(&d->rto[d->fly[i]->uid]);
+                disc_land(d, i, PROBE_SILENT);
+            }
+        }
+    }
+}
+
+static probe_res_t
+disc_read(disc_t *d, u8 uid, fc_t fc, int addr, int count) {
+    probe_t p = {.uid = uid, .fc = fc, .addr = addr, .count = count};
+    disc_run(d, &p, 1);
+    return p.res;
+}
+
+static int
+disc_valid(disc_t *d, u8 uid, fc_t fc, int addr) {
+    return disc_read(d, uid, fc, addr, 1) == PROBE_OK;
+}
+
+// ======================================================================================
+// Address map
+// ======================================================================================
+
+#define MAP_SET(m, a) ((m)[(a) >> 3] |= 1 << ((a) & 7))
+#define MAP_GET(m, a) ((m)[(a) >> 3] & 1 << ((a) & 7))
+
+// read range in requests as big as fc allows, the ones refused are split in halves down to single items
+static void
+disc_verify(disc_t *d, u8 uid, fc_t fc, int from, int count, u8 *map) {
+    if (disc_read(d, uid, fc, from, count) == PROBE_OK) {
+        for (int a = from; a < from + count; a++) {
+            MAP_SET(map, a);
+        }
+    } else if (count > 1 && !d->lost) {
+        disc_verify(d, uid, fc, from, count / 2, map);
+        disc_verify(d, uid, fc, from + count / 2, count - count / 2, map);
+    }
+}
+
+// the last valid address going from valid one by dir: gallop while valid, then binary search the edge
+static int
+disc_edge(disc_t *d, u8 uid, fc_t fc, int from, int dir) {
+    int good = from;
+    int step = 1;
+
+    while (1) {
+        int a = good + dir * step;
+        if (a < 0 || a > 0xFFFF || !disc_valid(d, uid, fc, a)) {
+            break;
+        }
+        good  = a;
+        step *= 2;
+    }
+
+    // good is valid, good + dir * step is not (or out of address space), gallop may overshoot the space
+    // by far, so bad is pulled back to just past its end to keep every mid a real address
+    int bad = CLAMP(good + dir * step, -1, 0x10000);
+    while (abs(bad - good) > 1) {
+        int mid = good + (bad - good) / 2;
+        if (disc_valid(d, uid, fc, mid)) {
+            good = mid;
+        } else {
+            bad = mid;
+        }
+    }
+
+    return good;
+}
+
+// map valid addresses of fc: coarse probes over the whole space, every hit is grown to its range
+// whose edges are binary searched with MB_EX_ILLEGAL_DATA_ADDRESS, then range is read through to find holes
+static int
+disc_map_fc(disc_t *d, u8 uid, fc_t fc, u8 *map) {
+    static probe_t coarse[0x10000 / DISCOVER_STRIDE + 2];
+
+    int max = fc == MB_FC_READ_COILS || fc == MB_FC_READ_DISCRETE_INPUTS ? MB_MAX_READ_BITS : MB_MAX_READ_REGS;
+
+    // slave which doesn't know fc says so or keeps quiet
+    probe_t first = {.uid = uid, .fc = fc, .addr = 0, .count = 1};
+    disc_run(d, &first, 1);
+    if (first.res == PROBE_SILENT || (first.res == PROBE_EXCEPTION && first.ex == MB_EX_ILLEGAL_FUNCTION)) {
+        return RC_FAIL;
+    }
+
+    int n = 0;
+    for (int a = 1; a <= 0xFFFF; a = a == 1 ? DISCOVER_STRIDE : a + DISCOVER_STRIDE) {
+        coarse[n++] = (probe_t){.uid = uid, .fc = fc, .addr = a, .count = 1};
+    }
+    disc_run(d, coarse, n);
+
+    // address 0 was probed on its own
+    int hit = first.res == PROBE_OK ? 0 : -1;
+    for (int i = -1; i < n && !d->lost; i++) {
+        int a = i < 0 ? hit : (coarse[i].res == PROBE_OK ? coarse[i].addr : -1);
+        if (a < 0 || MAP_GET(map, a)) {
+            continue;
+        }
+
+        int from = disc_edge(d, uid, fc, a, -1);
+        int to   = disc_edge(d, uid, fc, a, 1);
+        assert(from >= 0 && to <= 0xFFFF && from <= to);
+        for (int c = from; c <= to && !d->lost; c += max) {
+            disc_verify(d, uid, fc, c, MIN_VAL(max, to - c + 1), map);
+        }
+    }
+
+    return RC_SUCCESS;
+}
+
+// ranges of map in plan file syntax: 0-99,200,300-310, at most DISCOVER_RANGES of them starting at *next,
+// *next is moved past them, so map is written over as many lines as it takes
+static int
+disc_ranges(const u8 *map, int *next, char *out, int size) {
+    int len = 0;
+    int n   = 0;
+    int a   = *next;
+
+    out[0] = '\0';
+    while (a <= 0xFFFF && n < DISCOVER_RANGES) {
+        if (!MAP_GET(map, a)) {
+            a++;
+            continue;
+        }
+
+        int from = a;
+        while (a + 1 <= 0xFFFF && MAP_GET(map, a + 1)) {
+            a++;
+        }
+
+        int add = from == a ? snprintf(out + len, size - len, "%s%d", len ? "," : "", from)
+                            : snprintf(out + len, size - len, "%s%d-%d", len ? "," : "", from, a);
+        if (add >= size - len) {
+            log_linef("! discovery: address list truncated at %d, rest goes to next line", from);
+            out[len] = '\0';
+            a        = from;
+            break;
+        }
+        len += add;
+        n++;
+        a++;
+    }
+
+    *next = len ? a : 0x10000;
+    return len;
+}
+
+// ======================================================================================
+// Base
+// ======================================================================================
+
+// find every slave of the bus and which addresses of fc 1-4 it has, map is written as --plan file
+// which reads all of them (one or more 'read' lines per fc)
+int
+discover(global_t *global, const char *path) {
+    static disc_t  d;
+    static probe_t sweep[DISCOVER_MAX_UID];
+    static u8      map[0x10000 / 8];
+    static char    ranges[4096];
+
+    if (uplink_kind(global->cxt.protocol) == UPLINK_STREAM) {
+        u64 deadline = now_us() + (u64)MAX_VAL(global->response_timeout, 1000) * 1000;
+        while (!uplink_tcp_ready(global, deadline) && now_us() < deadline) {
+            msleep(10);
+        }
+    }
+    if (global->cxt.fd < 0) {
+        log_linef("! discovery: no connection");
+        return RC_FAIL;
+    }
+
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        log_linef("! discovery: '%s': %s", path, strerror(errno));
+        return RC_FAIL;
+    }
+
+    memset(&d, 0, sizeof(d));
+    d.fd       = global->cxt.fd;
+    d.protocol = global->cxt.protocol;
+    d.window   = mb_framing(d.protocol) == MB_PROTOCOL_TCP ? DISCOVER_WINDOW : 1;
+
+    char endpoint[32] = {0};
+    str_curr_endpoint(endpoint, global);
+    fprintf(f, "# device map of %s %s, use it as --plan\n", str_protocol(d.protocol), endpoint);
+
+    // any answer, even exception, means there is a slave
+    u64 start = now_us();
+    log_linef("> discovery: probing unit ids 1-%d, %d at once", DISCOVER_MAX_UID, d.window);
+    for (int i = 0; i < DISCOVER_MAX_UID; i++) {
+        sweep[i] = (probe_t){.uid = i + 1, .fc = MB_FC_READ_HOLDING_REGISTERS, .addr = 0, .count = 1};
+    }
+    disc_run(&d, sweep, DISCOVER_MAX_UID);
+
+    int found = 0;
+    for (int i = 0; i < DISCOVER_MAX_UID && !d.lost; i++) {
+        if (sweep[i].res != PROBE_OK && sweep[i].res != PROBE_EXCEPTION) {
+            continue;
+        }
+
+        u8 uid = sweep[i].uid;
+        found++;
+        log_linef("> discovery: uid %d found", uid);
+        fprintf(f, "\n# uid %d\n", uid);
+
+        for (fc_t fc = MB_FC_READ_COILS; fc <= MB_FC_READ_INPUT_REGISTERS && !d.lost; fc++) {
+            memset(map, 0, sizeof(map));
+            if (!disc_map_fc(&d, uid, fc, map)) {
+                continue;
+            }
+
+            for (int next = 0; disc_ranges(map, &next, ranges, sizeof(ranges));) {
+                log_linef("  uid %d fc %d: %.64s%s", uid, fc, ranges, strlen(ranges) > 64 ? "..." : "");
+                fprintf(f, "read fc=%d uid=%d addr=%s\n", fc, uid, ranges);
+            }
+        }
+    }
+    fclose(f);
+
+    log_linef("> discovery: %d slaves, %u requests in %.1f s, map written to %s", found, d.sent,
+      (now_us() - start) / 1e6, path);
+    return d.lost ? RC_FAIL : RC_SUCCESS;
+}
@@ -0,0 +1,13 @@
+#ifndef DISCOVER_H
+#define DISCOVER_H
+
+#include "client_cxt.h"
+
+#define DISCOVER_MAX_UID 247
+#define DISCOVER_WINDOW  32  // tcp and udp probes in flight at once, matched by tid
+#define DISCOVER_STRIDE  100 // address map probes one address of that many, shorter ranges between them may be missed
+#define DISCOVER_RANGES  256 // ranges per 'read' line of map, keeps lines far below what --plan reads at once
+
+int discover(global_t *global, const char *path);
+
+#endif
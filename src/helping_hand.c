@@ -99,8 +99,8 @@ sconf_from_str(serial_cfg *sconf, char *device, char *baud, char *dbits, char *s
 
     if (parse_int(baud, &sconf->baud) < 0) {
         return RC_FAIL;
-    } else if (sconf->baud < 0 || sconf->baud > 921600) {
-        log_line("! baudrate must be between 0 and 921600");
+    } else if (sconf->baud < 0 || sconf->baud > 4000000) {
+        log_line("! baudrate must be between 0 and 4000000");
         return RC_FAIL;
     }
 
@@ -304,6 +304,8 @@ str_curr_endpoint(char out[32], global_t *global) {
         break;
 
     case MB_PROTOCOL_TCP:
+    case MB_PROTOCOL_UDP:
+    case MB_PROTOCOL_RTU_TCP:
         if (!global->tcp_endp.host || !global->tcp_endp.tcp_port) {
             log_line("! TCP endpoint undefined");
             snprintf(out, 32, "<null>");
@@ -326,6 +328,20 @@ now_ms(void) {
     return (u64)ts.tv_sec * 1000ull + (u64)ts.tv_nsec / 1000000ull;
 }
 
+u64
+now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000ull + (u64)ts.tv_nsec / 1000ull;
+}
+
+u64
+now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
 void
 msleep(int ms) {
     struct timespec ts;
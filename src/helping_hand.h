@@ -21,6 +21,8 @@ int  wdata_from_str(global_t *global, char *str);
 int  int_from_str(int *i, char *str);
 void str_curr_endpoint(char out[32], global_t *global);
 u64  now_ms(void);
+u64  now_us(void);
+u64  now_ns(void);
 void msleep(int ms);
 int  fc_flags(int function_code);
 rc_t validate_ip(const char *ip);
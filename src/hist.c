@@ -0,0 +1,203 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "hist.h"
+#include "types.h"
+
+// ======================================================================================
+// Buckets
+
+static int
+hist_index(u64 us) {
+    if (us < HIST_SUB) {
+        return us;
+    }
+
+    // shift leaves HIST_SUB_BITS significant bits of value, the top one is always set
+    int shift = 63 - __builtin_clzl(us) - (HIST_SUB_BITS - 1);
+    int index = HIST_SUB + (shift - 1) * HIST_HALF + (int)(us >> shift) - HIST_HALF;
+    return MIN_VAL(index, HIST_LEN - 1);
+}
+
+static u64
+hist_lowest(int index) {
+    if (index < HIST_SUB) {
+        return index;
+    }
+
+    int shift = (index - HIST_SUB) / HIST_HALF + 1;
+    return (u64)((index - HIST_SUB) % HIST_HALF + HIST_HALF) << shift;
+}
+
+// the largest value which falls in the same bucket, values are reported by it like hdr histogram does
+static u64
+hist_highest(int index) {
+    if (index < HIST_SUB) {
+        return index;
+    }
+
+    int shift = (index - HIST_SUB) / HIST_HALF + 1;
+    return hist_lowest(index) + ((u64)1 << shift) - 1;
+}
+
+// ======================================================================================
+// Writer
+
+void
+hist_record(hist_t *h, u64 us) {
+    u32 epoch = __atomic_load_n(&stats_epoch, __ATOMIC_RELAXED);
+    if (h->epoch != epoch) {
+        for (int i = 0; i < HIST_LEN; i++) {
+            __atomic_store_n(&h->counts[i], 0, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&h->count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->sum_us, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(&h->epoch, epoch, __ATOMIC_RELEASE);
+    }
+
+    int i = hist_index(us);
+    __atomic_store_n(&h->counts[i], h->counts[i] + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->sum_us, h->sum_us + us, __ATOMIC_RELAXED);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+}
+
+// coordinated omission: requests which were due every interval_us while this one stalled were never sent,
+// they are recorded as if they waited for it, 0 - nothing is back filled
+void
+hist_record_co(hist_t *h, u64 us, u64 interval_us) {
+    hist_record(h, us);
+    if (!interval_us) {
+        return;
+    }
+
+    for (u64 missed = us; missed >= 2 * interval_us;) {
+        missed -= interval_us;
+        hist_record(h, missed);
+    }
+}
+
+// ======================================================================================
+// Readers
+
+// merge histogram of one thread into out, out belongs to the current reset
+void
+hist_read(hist_t *out, const hist_t *h) {
+    u32 epoch  = __atomic_load_n(&stats_epoch, __ATOMIC_RELAXED);
+    out->epoch = epoch;
+    if (__atomic_load_n(&h->epoch, __ATOMIC_ACQUIRE) != epoch) {
+        return;
+    }
+
+    // count is taken from buckets, so it always matches them while writer goes on
+    for (int i = 0; i < HIST_LEN; i++) {
+        u64 n           = __atomic_load_n(&h->counts[i], __ATOMIC_RELAXED);
+        out->counts[i] += n;
+        out->count     += n;
+    }
+    out->sum_us += __atomic_load_n(&h->sum_us, __ATOMIC_RELAXED);
+}
+
+// what was recorded into merged h since base was taken, base of the other reset counts as empty
+void
+hist_diff(hist_t *out, const hist_t *h, const hist_t *base) {
+    *out = *h;
+    if (base->epoch != h->epoch) {
+        return;
+    }
+
+    out->count  = 0;
+    out->sum_us = h->sum_us - MIN_VAL(base->sum_us, h->sum_us);
+    for (int i = 0; i < HIST_LEN; i++) {
+        out->counts[i]  = h->counts[i] - MIN_VAL(base->counts[i], h->counts[i]);
+        out->count     += out->counts[i];
+    }
+}
+
+// percentile in 0-100, 0 if nothing is recorded
+u64
+hist_percentile(const hist_t *h, double percentile) {
+    if (!h->count) {
+        return 0;
+    }
+
+    u64 rank = (u64)ceil(percentile / 100 * h->count);
+    rank     = CLAMP(rank, 1, h->count);
+
+    u64 seen = 0;
+    for (int i = 0; i < HIST_LEN; i++) {
+        seen += h->counts[i];
+        if (seen >= rank) {
+            return hist_highest(i);
+        }
+    }
+    return hist_highest(HIST_LEN - 1);
+}
+
+void
+hist_summary(const hist_t *h, hist_sum_t *out) {
+    *out = (hist_sum_t){.count = h->count};
+    if (!h->count) {
+        return;
+    }
+
+    for (int i = 0; i < HIST_LEN; i++) {
+        if (h->counts[i]) {
+            out->min = hist_lowest(i);
+            break;
+        }
+    }
+    for (int i = HIST_LEN - 1; i >= 0; i--) {
+        if (h->counts[i]) {
+            out->max = hist_highest(i);
+            break;
+        }
+    }
+
+    out->mean = h->sum_us / h->count;
+    out->p50  = hist_percentile(h, 50);
+    out->p90  = hist_percentile(h, 90);
+    out->p99  = hist_percentile(h, 99);
+    out->p999 = hist_percentile(h, 99.9);
+}
+
+// percentile distribution in hdr histogram text format, one line per non empty bucket,
+// so runs can be compared with its plotter
+int
+hist_dump(const hist_t *h, const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) {
+        return RC_ERROR;
+    }
+
+    double mean = h->count ? (double)h->sum_us / h->count : 0;
+    double var  = 0;
+    u64    seen = 0;
+    u64    max  = 0;
+
+    fprintf(f, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    for (int i = 0; i < HIST_LEN; i++) {
+        if (!h->counts[i]) {
+            continue;
+        }
+
+        u64 value = hist_highest(i);
+        seen     += h->counts[i];
+        var      += h->counts[i] * (value - mean) * (value - mean);
+        max       = value;
+
+        double q = (double)seen / h->count;
+
+        if (q < 1) {
+            fprintf(f, "%12.3f %14.12f %10lu %14.2f\n", (double)value, q, seen, 1 / (1 - q));
+        } else {
+            fprintf(f, "%12.3f %14.12f %10lu %14s\n", (double)value, q, seen, "inf");
+        }
+    }
+
+    fprintf(f, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean, h->count ? sqrt(var / h->count) : 0);
+    fprintf(f, "#[Max     = %12.3f, Total count    = %12lu]\n", (double)max, h->count);
+    fprintf(f, "#[Buckets = %12d, SubBuckets     = %12d]\n", 32 - HIST_SUB_BITS + 1, HIST_SUB);
+
+    fclose(f);
+    return RC_SUCCESS;
+}
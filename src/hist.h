@@ -0,0 +1,44 @@
+#ifndef HIST_H
+#define HIST_H
+
+#include "stats.h"
+#include "types.h"
+
+// log-linear histogram of response time in us: exact values below HIST_SUB, then every power of two
+// is split in HIST_HALF buckets, so any value is kept with error below 1/HIST_HALF
+#define HIST_SUB_BITS 7
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_HALF     (HIST_SUB / 2)
+#define HIST_LEN      (HIST_SUB + (32 - HIST_SUB_BITS) * HIST_HALF) // up to 2^32 us, longer go to the last bucket
+
+#define HIST_WINDOW_S 10 // sliding window latency is shown over
+
+// like statistic_t, one per thread, written only by it and merged by readers with hist_read()
+typedef struct hist {
+    u32 epoch; // reset it belongs to, see stats_reset()
+    u64 count;
+    u64 sum_us;
+    u64 counts[HIST_LEN];
+} __attribute__((aligned(STATS_LINE))) hist_t;
+
+// latency summary of histogram or window of it
+typedef struct {
+    u64 count;
+    u64 min;
+    u64 mean;
+    u64 p50;
+    u64 p90;
+    u64 p99;
+    u64 p999;
+    u64 max;
+} hist_sum_t;
+
+void hist_record(hist_t *h, u64 us);
+void hist_record_co(hist_t *h, u64 us, u64 interval_us);
+void hist_read(hist_t *out, const hist_t *h);
+void hist_diff(hist_t *out, const hist_t *h, const hist_t *base);
+u64  hist_percentile(const hist_t *h, double percentile);
+void hist_summary(const hist_t *h, hist_sum_t *out);
+int  hist_dump(const hist_t *h, const char *path);
+
+#endif
@@ -0,0 +1,214 @@
+#define _GNU_SOURCE
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "helping_hand.h"
+#include "link.h"
+#include "tui.h"
+
+void
+link_init(link_t *l, tcp_endp *endp) {
+    memset(l, 0, sizeof(*l));
+
+    l->endp       = *endp;
+    l->state      = LINK_DOWN;
+    l->fd         = -1;
+    l->backoff_us = LINK_BACKOFF_MIN_US;
+}
+
+static void
+link_up(link_t *l, u64 now) {
+    l->state      = LINK_UP;
+    l->connect_us = now - l->started_us;
+    l->backoff_us = LINK_BACKOFF_MIN_US;
+    l->connects++;
+
+    log_linef("> connected to %s:%d in %u us (fd: %d)", l->endp.host, l->endp.tcp_port, l->connect_us, l->fd);
+}
+
+// equal jitter: half of backoff is fixed, other half random, so many connections don't retry in lockstep
+static void
+link_fail(link_t *l, int err, u64 now) {
+    if (l->fd >= 0) {
+        close(l->fd);
+        l->fd = -1;
+    }
+
+    u32 half = l->backoff_us / 2;
+
+    l->state      = LINK_BACKOFF;
+    l->retry_us   = now + half + random() % (half + 1);
+    l->backoff_us = MIN_VAL((u64)l->backoff_us * 2, LINK_BACKOFF_MAX_US);
+    l->failures++;
+
+    log_linef("! %s:%d: connect failed: %s, retry in %lu ms", l->endp.host, l->endp.tcp_port, strerror(err),
+      (l->retry_us - now) / 1000);
+}
+
+// start non-blocking connect, completion is reported by writability of fd
+void
+link_start(link_t *l, u64 now) {
+    if (l->state == LINK_UP || l->state == LINK_CONNECTING) {
+        return;
+    } else if (l->state == LINK_BACKOFF && now < l->retry_us) {
+        return;
+    }
+
+    l->started_us = now;
+
+    l->fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (l->fd < 0) {
+        link_fail(l, errno, now);
+        return;
+    }
+
+    struct sockaddr_in sa = {
+      .sin_family      = AF_INET,
+      .sin_port        = htons(l->endp.tcp_port),
+      .sin_addr.s_addr = inet_addr(l->endp.host),
+    };
+
+    if (connect(l->fd, (struct sockaddr *)&sa, sizeof(sa)) == 0) {
+        // loopback can connect right away
+        link_up(l, now);
+    } else if (errno == EINPROGRESS) {
+        l->state = LINK_CONNECTING;
+    } else {
+        link_fail(l, errno, now);
+    }
+}
+
+// fd became writable, SO_ERROR tells whether connect succeeded
+void
+link_connected(link_t *l, u64 now) {
+    if (l->state != LINK_CONNECTING) {
+        return;
+    }
+
+    int       err = 0;
+    socklen_t len = sizeof(err);
+    if (getsockopt(l->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) {
+        err = errno;
+    }
+
+    if (err) {
+        link_fail(l, err, now);
+    } else {
+        link_up(l, now);
+    }
+}
+
+// for owners without event loop: look if connect is done without waiting, expire it if it takes too long
+void
+link_check(link_t *l, u64 now) {
+    if (l->state != LINK_CONNECTING) {
+        return;
+    }
+
+    struct pollfd pfd = {
+      .fd     = l->fd,
+      .events = POLLOUT,
+    };
+
+    if (poll(&pfd, 1, 0) > 0) {
+        link_connected(l, now);
+    } else if (now >= l->started_us + LINK_CONNECT_TIMEOUT_US) {
+        link_fail(l, ETIMEDOUT, now);
+    }
+}
+
+// move state machine forward as far as it goes without blocking
+void
+link_step(link_t *l, u64 now) {
+    switch (l->state) {
+    case LINK_DOWN:
+    case LINK_BACKOFF: link_start(l, now); break;
+    case LINK_CONNECTING: link_check(l, now); break;
+    case LINK_UP: break;
+    }
+}
+
+// owner closed fd after read or write failure
+void
+link_lost(link_t *l, u64 now) {
+    if (l->state != LINK_UP) {
+        return;
+    }
+
+    // peer which accepts and drops right away shouldn't be hammered, so go through backoff
+    l->fd         = -1;
+    l->state      = LINK_BACKOFF;
+    l->retry_us   = now + l->backoff_us / 2 + random() % (l->backoff_us / 2 + 1);
+    l->backoff_us = MIN_VAL((u64)l->backoff_us * 2, LINK_BACKOFF_MAX_US);
+}
+
+void
+link_close(link_t *l) {
+    if (l->fd >= 0) {
+        close(l->fd);
+        l->fd = -1;
+    }
+    l->state = LINK_DOWN;
+}
+
+// when owner has to look at this link again, 0 - nothing scheduled
+u64
+link_next_us(link_t *l) {
+    switch (l->state) {
+    case LINK_BACKOFF: return l->retry_us;
+    case LINK_CONNECTING: return l->started_us + LINK_CONNECT_TIMEOUT_US;
+    default: return 0;
+    }
+}
+
+// fail over to warm standby: take its connected socket, standby starts connecting anew
+int
+link_take(link_t *l, link_t *standby) {
+    if (l->state == LINK_UP || standby->state != LINK_UP) {
+        return FALSE;
+    }
+
+    // standby sat idle, peer could close it in the meantime
+    u8 probe = 0;
+    if (recv(standby->fd, &probe, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+        link_close(standby);
+        return FALSE;
+    }
+
+    if (l->fd >= 0) {
+        close(l->fd);
+    }
+
+    l->fd         = standby->fd;
+    l->state      = LINK_UP;
+    l->connect_us = standby->connect_us;
+    l->backoff_us = LINK_BACKOFF_MIN_US;
+    l->connects++;
+
+    standby->fd    = -1;
+    standby->state = LINK_DOWN;
+
+    log_linef("> %s:%d: switched to standby connection (fd: %d)", l->endp.host, l->endp.tcp_port, l->fd);
+    return TRUE;
+}
+
+void
+link_str_state(link_t *l, char *out, int out_size) {
+    u64 now = now_us();
+
+    switch (l->state) {
+    case LINK_DOWN: snprintf(out, out_size, "down"); break;
+    case LINK_CONNECTING: snprintf(out, out_size, "connecting %lu ms", (now - l->started_us) / 1000); break;
+    case LINK_UP: snprintf(out, out_size, "up, connect %u us", l->connect_us); break;
+    case LINK_BACKOFF:
+        snprintf(out, out_size, "retry in %lu ms", l->retry_us > now ? (l->retry_us - now) / 1000 : 0);
+        break;
+    }
+}
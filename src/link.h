@@ -0,0 +1,43 @@
+#ifndef LINK_H
+#define LINK_H
+
+#include "client_cxt.h"
+
+#define LINK_CONNECT_TIMEOUT_US 3000000  // connect that takes longer than that counts as failed
+#define LINK_BACKOFF_MIN_US     100000   // first retry after failure
+#define LINK_BACKOFF_MAX_US     30000000 // backoff doubles after every failure up to that
+
+typedef enum link_state {
+    LINK_DOWN,       // nothing in progress, connect can start right away
+    LINK_CONNECTING, // non-blocking connect in progress on fd
+    LINK_UP,         // fd is connected
+    LINK_BACKOFF,    // last attempt failed, next one not before retry_us
+} link_state_t;
+
+// tcp connection to one endpoint which reconnects by itself, never blocks
+typedef struct link {
+    tcp_endp     endp;
+    link_state_t state;
+    int          fd;
+
+    u64 started_us; // when current connect started
+    u64 retry_us;   // backoff: when next connect can start
+    u32 backoff_us; // backoff before the next retry, with jitter applied on top
+    u32 connect_us; // how long the last successful connect took
+
+    u32 connects;
+    u32 failures;
+} link_t;
+
+void link_init(link_t *l, tcp_endp *endp);
+void link_start(link_t *l, u64 now);
+void link_connected(link_t *l, u64 now);
+void link_check(link_t *l, u64 now);
+void link_step(link_t *l, u64 now);
+void link_lost(link_t *l, u64 now);
+void link_close(link_t *l);
+u64  link_next_us(link_t *l);
+int  link_take(link_t *l, link_t *standby);
+void link_str_state(link_t *l, char *out, int out_size);
+
+#endif
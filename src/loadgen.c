@@ -0,0 +1,839 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include "helping_hand.h"
+#include "loadgen.h"
+#include "tui.h"
+#include "uplink.h"
+
+#define WORKER_MAX_EVENTS   64
+#define WORKER_IDLE_MS      10
+#define WORKER_MAX_SLEEP_US 50000   // how often worker looks around even if there is nothing to do
+
+// io_uring user_data: connection id, fd generation and operation
+#define URING_OP_RECV      1
+#define URING_OP_SEND      2
+#define URING_OP_CANCEL    3
+#define URING_OP_CONNECT   4
+#define URING_UDATA(c, op) (((u64)(c)->id << 32) | ((u64)(c)->gen << 8) | (op))
+
+// idle workers sleep on it until tui starts a run
+static pthread_mutex_t idle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  idle_cond  = PTHREAD_COND_INITIALIZER;
+
+static worker_t *workers;
+static conn_t   *conns;
+static int       nworkers;
+static int       nconns;
+static int       ntargets;     // main endpoint + fleet
+static int       per_endpoint; // connections to each of targets
+
+// ======================================================================================
+// Connection
+// ======================================================================================
+
+// take settings of the next run from globals, fd, tid, template, plan cursor and response time
+// estimates are connection's own and are kept across runs
+static void
+conn_refresh(conn_t *c) {
+    mb_protocol_t was = c->cxt.protocol;
+
+    c->cxt.protocol    = globals.cxt.protocol;
+    c->cxt.fc          = globals.cxt.fc;
+    c->cxt.waddress    = globals.cxt.waddress;
+    c->cxt.wcount      = globals.cxt.wcount;
+    c->cxt.raddress    = globals.cxt.raddress;
+    c->cxt.rcount      = globals.cxt.rcount;
+    c->cxt.current_uid = globals.slave_id_start;
+    memcpy(c->cxt.wdata, globals.cxt.wdata, sizeof(c->cxt.wdata));
+
+    // open loop rate is split over connections, their requests are spread evenly over the period
+    u64 now    = now_ns();
+    u64 period = sched_period(globals.sched_mode, globals.rate, globals.timeout, nconns);
+    u64 first  = sched_open_loop(globals.sched_mode) ? now + period / nconns * c->id : now;
+    sched_start(&c->sched, globals.sched_mode, period, first, now);
+    c->pipe.backfill_us = sched_backfill_us(&c->sched);
+    if (globals.profile) {
+        sched_profile(&c->sched, globals.profile, nconns);
+    }
+    if (globals.sched_mode == SCHED_SCAN) {
+        c->cxt.plan.left = 0;
+        scan_start(&c->scan, now);
+    }
+
+    // endpoint or transport was changed from tui, this connection is stale
+    if (memcmp(&c->link.endp, c->target, sizeof(c->link.endp)) != 0 ||
+        uplink_kind(was) != uplink_kind(c->cxt.protocol)) {
+        // udp socket is not owned by link
+        if (c->cxt.fd >= 0 && c->cxt.fd != c->link.fd) {
+            close(c->cxt.fd);
+        }
+        link_close(&c->link);
+        link_close(&c->standby);
+        link_init(&c->link, c->target);
+        link_init(&c->standby, c->target);
+        c->cxt.fd = -1;
+        snprintf(c->name, sizeof(c->name), "%s:%d", c->target->host, c->target->tcp_port);
+    }
+}
+
+// connecting fd is watched for writability, connected one for data
+static void
+conn_watch(worker_t *w, conn_t *c, int fd, int connecting) {
+    if (w->ring) {
+        if (connecting) {
+            uring_prep_poll(uring_get_sqe(w->ring), fd, POLLOUT, URING_UDATA(c, URING_OP_CONNECT));
+        } else {
+            // one multishot receive serves connection until it is closed
+            uring_prep_recv_multishot(uring_get_sqe(w->ring), fd, URING_UDATA(c, URING_OP_RECV));
+        }
+        c->ep_fd      = fd;
+        c->ep_connect = connecting;
+        return;
+    }
+
+    struct epoll_event ev = {
+      .events   = connecting ? EPOLLOUT : EPOLLIN,
+      .data.ptr = c,
+    };
+
+    w->syscalls++;
+    if (epoll_ctl(w->epfd, c->ep_fd == fd ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev) < 0) {
+        log_linef("! conn %d: failed to watch fd: %s", c->id, strerror(errno));
+        return;
+    }
+    c->ep_fd      = fd;
+    c->ep_connect = connecting;
+}
+
+// fd is closed already, closed fds are removed from epoll by kernel,
+// but io_uring holds the file until its requests are cancelled
+static void
+conn_unwatch(worker_t *w, conn_t *c) {
+    if (w->ring) {
+        if (c->ep_connect) {
+            uring_prep_cancel(uring_get_sqe(w->ring), URING_UDATA(c, URING_OP_CONNECT), URING_OP_CANCEL);
+        } else {
+            uring_prep_cancel(uring_get_sqe(w->ring), URING_UDATA(c, URING_OP_RECV), URING_OP_CANCEL);
+        }
+        if (c->tx_busy) {
+            uring_prep_cancel(uring_get_sqe(w->ring), URING_UDATA(c, URING_OP_SEND), URING_OP_CANCEL);
+        }
+
+        c->gen++;
+        c->tx_busy = 0;
+    }
+
+    c->tx_len     = 0;
+    c->tx_count   = 0;
+    c->ep_fd      = -1;
+    c->ep_connect = FALSE;
+}
+
+// drive connection state machine and keep worker's epoll or io_uring in sync with its fd, never blocks
+static void
+conn_sync(worker_t *w, conn_t *c, u64 now) {
+    // udp has nothing to connect, socket is just reopened if pipeline closed it
+    if (uplink_kind(c->cxt.protocol) == UPLINK_DGRAM) {
+        if (c->ep_fd >= 0 && c->ep_fd != c->cxt.fd) {
+            conn_unwatch(w, c);
+        }
+        if (c->cxt.fd < 0) {
+            c->cxt.fd = open_udp(c->target);
+        }
+        if (c->cxt.fd >= 0 && c->ep_fd != c->cxt.fd) {
+            conn_watch(w, c, c->cxt.fd, FALSE);
+        }
+        return;
+    }
+
+    // pipeline closed fd it was using, fail over to standby or go through backoff
+    if (c->link.state == LINK_UP && c->ep_fd == c->link.fd && !c->ep_connect && c->cxt.fd != c->link.fd) {
+        link_lost(&c->link, now);
+        if (globals.standby) {
+            link_take(&c->link, &c->standby);
+        }
+    }
+
+    // forget old fd before new connection possibly gets the same number
+    if (c->ep_fd >= 0 && c->ep_fd != c->link.fd) {
+        conn_unwatch(w, c);
+    }
+
+    if (c->link.state == LINK_DOWN || c->link.state == LINK_BACKOFF) {
+        link_start(&c->link, now);
+    } else if (c->link.state == LINK_CONNECTING && now >= link_next_us(&c->link)) {
+        link_check(&c->link, now);
+        if (c->link.state != LINK_CONNECTING) {
+            conn_unwatch(w, c);
+        }
+    }
+
+    if (c->link.state == LINK_CONNECTING && c->ep_fd != c->link.fd) {
+        conn_watch(w, c, c->link.fd, TRUE);
+    } else if (c->link.state == LINK_UP && (c->ep_fd != c->link.fd || c->ep_connect)) {
+        c->cxt.fd = c->link.fd;
+        conn_watch(w, c, c->link.fd, FALSE);
+    }
+
+    // standby only sits connected, nothing is sent over it, so polling it here is enough
+    if (globals.standby) {
+        link_step(&c->standby, now);
+    }
+}
+
+// next time conn_sync has something to do for connection which is not up
+static u64
+conn_next_us(conn_t *c) {
+    u64 next = link_next_us(&c->link);
+    u64 spare = globals.standby ? link_next_us(&c->standby) : 0;
+
+    if (!next || (spare && spare < next)) {
+        next = spare;
+    }
+
+    return next;
+}
+
+// all staged datagrams go out with one syscall
+static void
+conn_flush(worker_t *w, conn_t *c) {
+    struct mmsghdr msgs[LOADGEN_UDP_BATCH] = {0};
+    struct iovec   iov[LOADGEN_UDP_BATCH];
+
+    int off = 0;
+    for (int i = 0; i < c->tx_count; i++) {
+        iov[i].iov_base = &c->tx[off];
+        iov[i].iov_len  = c->tx_dgram[i];
+        off            += c->tx_dgram[i];
+
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent = 0;
+    while (sent < c->tx_count) {
+        w->syscalls++;
+        int rc = sendmmsg(c->cxt.fd, &msgs[sent], c->tx_count - sent, MSG_DONTWAIT);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        } else if (rc < 0) {
+            // requests are in flight already, they will time out
+            log_linef("! conn %d: failed to send %d datagrams: %s", c->id, c->tx_count - sent, strerror(errno));
+            break;
+        }
+        sent += rc;
+    }
+
+    c->tx_len   = 0;
+    c->tx_count = 0;
+}
+
+// every datagram is a response on its own, take as many as there are with one syscall
+static void
+conn_recv_mmsg(worker_t *w, conn_t *c) {
+    static __thread u8 bufs[LOADGEN_UDP_BATCH][MB_MAX_ADU_LEN];
+
+    struct mmsghdr msgs[LOADGEN_UDP_BATCH] = {0};
+    struct iovec   iov[LOADGEN_UDP_BATCH];
+
+    for (int i = 0; i < LOADGEN_UDP_BATCH; i++) {
+        iov[i].iov_base = bufs[i];
+        iov[i].iov_len  = MB_MAX_ADU_LEN;
+
+        msgs[i].msg_hdr.msg_iov    = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = LOADGEN_UDP_BATCH;
+    while (n == LOADGEN_UDP_BATCH && c->cxt.fd >= 0) {
+        w->syscalls++;
+        n = recvmmsg(c->cxt.fd, msgs, LOADGEN_UDP_BATCH, MSG_DONTWAIT, NULL);
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                pipe_feed(&c->pipe, NULL, -errno);
+            }
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            // truncated datagram is longer than any adu, pipeline rejects it by length without reading it
+            int len = msgs[i].msg_hdr.msg_flags & MSG_TRUNC ? MB_MAX_ADU_LEN + 1 : (int)msgs[i].msg_len;
+            pipe_feed(&c->pipe, bufs[i], len);
+        }
+    }
+}
+
+// epoll writes tcp request right away, udp and io_uring stage it until batch goes out
+static int
+conn_send(worker_t *w, conn_t *c) {
+    int udp = uplink_kind(c->cxt.protocol) == UPLINK_DGRAM;
+
+    if (!w->ring && !udp) {
+        w->syscalls++;
+        return pipe_send(&c->pipe);
+    }
+
+    // epoll flushes full batch by itself, io_uring waits for the next submit
+    if (!w->ring && (c->tx_count == LOADGEN_UDP_BATCH || LOADGEN_TX_LEN - c->tx_len < MB_MAX_ADU_LEN)) {
+        conn_flush(w, c);
+    }
+
+    if (c->tx_busy || (udp && c->tx_count == LOADGEN_UDP_BATCH)) {
+        return RC_FAIL;
+    }
+
+    int len = pipe_stage(&c->pipe, &c->tx[c->tx_len], LOADGEN_TX_LEN - c->tx_len);
+    if (len <= 0) {
+        return RC_FAIL;
+    }
+    c->tx_len += len;
+
+    if (udp) {
+        c->tx_dgram[c->tx_count++] = len;
+    }
+
+    return RC_SUCCESS;
+}
+
+// ======================================================================================
+// Worker
+// ======================================================================================
+
+// fire sequence is shared by all connections, take one request from it
+static int
+take_budget() {
+    if (!globals.running) {
+        return FALSE;
+    }
+
+    if (!globals.rfire_count) {
+        return TRUE;
+    }
+
+    u32 cur = __atomic_load_n(&globals.rfire_current, __ATOMIC_RELAXED);
+    do {
+        if (cur >= globals.rfire_count) {
+            return FALSE;
+        }
+    } while (!__atomic_compare_exchange_n(
+      &globals.rfire_current, &cur, cur + 1, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+    return TRUE;
+}
+
+// scan table: the next request belongs to a group being polled or to one whose deadline came
+static int
+conn_scan_due(conn_t *c, u64 now) {
+    return globals.sched_mode != SCHED_SCAN || scan_step(&c->scan, &c->cxt.plan, now * 1000);
+}
+
+// send what we can over every connection, returns when worker should wake up next time
+static u64
+worker_send(worker_t *w, u64 now) {
+    u64 wake = now + WORKER_MAX_SLEEP_US;
+
+    for (int i = 0; i < w->nconns; i++) {
+        conn_t *c = &w->conns[i];
+
+        conn_sync(w, c, now);
+
+        u64 next = conn_next_us(c);
+        if (next) {
+            wake = MIN_VAL(wake, next);
+        }
+        if (c->cxt.fd < 0) {
+            continue;
+        }
+
+        // open loop catches up on everything due, closed loop keeps the window full
+        while (sched_due(&c->sched, now * 1000) && pipe_can_send(&c->pipe) && conn_scan_due(c, now) &&
+               take_budget()) {
+            c->pipe.intended_us = sched_intended_us(&c->sched);
+            if (!conn_send(w, c)) {
+                break;
+            }
+            sched_take(&c->sched, now * 1000);
+            sched_done(&c->sched, now * 1000);
+            if (globals.sched_mode == SCHED_SCAN) {
+                c->sched.next_ns = scan_next_ns(&c->scan, &c->cxt.plan);
+            }
+        }
+        if (!w->ring && c->tx_count) {
+            conn_flush(w, c);
+        }
+
+        u64 deadline = pipe_next_deadline(&c->pipe);
+        if (deadline) {
+            wake = MIN_VAL(wake, deadline);
+        }
+        if (!sched_due(&c->sched, now * 1000) && pipe_can_send(&c->pipe)) {
+            wake = MIN_VAL(wake, (c->sched.next_ns + 999) / 1000);
+        }
+    }
+
+    return wake;
+}
+
+static void
+worker_poll_epoll(worker_t *w, u64 wake) {
+    struct epoll_event events[WORKER_MAX_EVENTS];
+
+    u64 now     = now_us();
+    int timeout = wake > now ? (wake - now + 999) / 1000 : 0;
+
+    if (w->tfd >= 0 && timeout > 0) {
+        struct itimerspec its = {
+          .it_value = {.tv_sec = wake / 1000000, .tv_nsec = (wake % 1000000) * 1000},
+        };
+
+        w->syscalls++;
+        if (timerfd_settime(w->tfd, TFD_TIMER_ABSTIME, &its, NULL) == 0) {
+            timeout = -1;
+        }
+    }
+
+    w->syscalls++;
+    int n = epoll_wait(w->epfd, events, WORKER_MAX_EVENTS, timeout);
+    for (int i = 0; i < n; i++) {
+        conn_t *c = events[i].data.ptr;
+
+        // timer, it only had to wake us up
+        if (!c) {
+            continue;
+        }
+
+        if (c->ep_connect) {
+            w->syscalls++;
+            link_connected(&c->link, now_us());
+            conn_sync(w, c, now_us());
+        } else if (uplink_kind(c->cxt.protocol) == UPLINK_DGRAM) {
+            conn_recv_mmsg(w, c);
+        } else {
+            w->syscalls++;
+            pipe_recv(&c->pipe);
+        }
+    }
+}
+
+static void
+worker_complete(worker_t *w, struct io_uring_cqe *cqe) {
+    int op  = cqe->user_data & 0xff;
+    u8 *buf = NULL;
+
+    // buffer goes back to kernel whatever happens with the data
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        buf = uring_buf(w->ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+
+    conn_t *c = op == URING_OP_CANCEL ? NULL : &conns[cqe->user_data >> 32];
+
+    // completion of already closed fd
+    if (c && (u16)(cqe->user_data >> 8) != c->gen) {
+        c = NULL;
+    }
+
+    if (c && op == URING_OP_RECV) {
+        if (cqe->res > 0) {
+            pipe_feed(&c->pipe, buf, cqe->res);
+        } else if (cqe->res != -ENOBUFS) {
+            pipe_feed(&c->pipe, NULL, cqe->res);
+        }
+
+        // kernel stopped multishot receive (ran out of buffers), connection is still fine
+        if (!(cqe->flags & IORING_CQE_F_MORE) && c->cxt.fd >= 0 && c->cxt.fd == c->ep_fd) {
+            conn_watch(w, c, c->ep_fd, FALSE);
+        }
+    } else if (c && op == URING_OP_CONNECT) {
+        link_connected(&c->link, now_us());
+        conn_sync(w, c, now_us());
+    } else if (c && op == URING_OP_SEND) {
+        c->tx_busy--;
+
+        if (c->tx_count) {
+            // udp: datagram is sent whole or not at all, failed one just times out
+            if (cqe->res < 0) {
+                log_linef("! conn %d: failed to send: %s", c->id, strerror(-cqe->res));
+            }
+            if (!c->tx_busy) {
+                c->tx_len   = 0;
+                c->tx_count = 0;
+            }
+        } else if (cqe->res < 0) {
+            log_linef("! conn %d: failed to send: %s", c->id, strerror(-cqe->res));
+            c->tx_len = 0;
+            pipe_close(&c->pipe, "failed to send");
+        } else {
+            // short send, rest goes with the next submit
+            c->tx_len -= cqe->res;
+            memmove(c->tx, &c->tx[cqe->res], c->tx_len);
+        }
+    }
+
+    if (buf) {
+        uring_buf_recycle(w->ring, cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+    }
+}
+
+// everything staged during this pass goes to kernel with the same syscall that waits for completions
+static void
+worker_poll_uring(worker_t *w, u64 wake) {
+    for (int i = 0; i < w->nconns; i++) {
+        conn_t *c = &w->conns[i];
+
+        if (!c->tx_len || c->tx_busy || c->ep_fd < 0) {
+            continue;
+        }
+
+        // udp needs a send per datagram, stream takes everything at once
+        if (c->tx_count) {
+            int off = 0;
+            for (int j = 0; j < c->tx_count; j++) {
+                uring_prep_send(uring_get_sqe(w->ring), c->ep_fd, &c->tx[off], c->tx_dgram[j],
+                  URING_UDATA(c, URING_OP_SEND));
+                off += c->tx_dgram[j];
+            }
+            c->tx_busy = c->tx_count;
+        } else {
+            uring_prep_send(uring_get_sqe(w->ring), c->ep_fd, c->tx, c->tx_len, URING_UDATA(c, URING_OP_SEND));
+            c->tx_busy = 1;
+        }
+    }
+
+    if (uring_submit_and_wait(w->ring, wake) != RC_SUCCESS) {
+        log_linef("! worker %d: io_uring failed: %s", w->id, strerror(errno));
+        msleep(WORKER_IDLE_MS);
+    }
+
+    struct io_uring_cqe *cqe = NULL;
+    while (uring_peek_cqe(w->ring, &cqe)) {
+        worker_complete(w, cqe);
+        uring_cqe_seen(w->ring);
+    }
+}
+
+// handle whatever arrives until wake, then expire requests
+static void
+worker_poll(worker_t *w, u64 wake) {
+    if (w->ring) {
+        worker_poll_uring(w, wake);
+    } else {
+        worker_poll_epoll(w, wake);
+    }
+
+    u64 now = now_us();
+    for (int i = 0; i < w->nconns; i++) {
+        pipe_expire(&w->conns[i].pipe, now);
+    }
+}
+
+// wait for everything in flight to be answered or timed out
+static void
+worker_drain(worker_t *w) {
+    while (1) {
+        u64 wake = 0;
+
+        for (int i = 0; i < w->nconns; i++) {
+            u64 deadline = pipe_next_deadline(&w->conns[i].pipe);
+            if (deadline && (!wake || deadline < wake)) {
+                wake = deadline;
+            }
+        }
+
+        if (!wake) {
+            return;
+        }
+        worker_poll(w, wake);
+    }
+}
+
+static void *
+worker_thread(void *arg) {
+    worker_t *w           = arg;
+    u8        was_running = FALSE;
+
+    while (1) {
+        // statistic was reset, syscall counters are zeroed by the thread which counts them
+        u32 epoch = __atomic_load_n(&stats_epoch, __ATOMIC_RELAXED);
+        if (w->epoch != epoch) {
+            __atomic_store_n(&w->syscalls, 0, __ATOMIC_RELAXED);
+            if (w->ring) {
+                __atomic_store_n(&w->ring->enters, 0, __ATOMIC_RELAXED);
+            }
+            w->epoch = epoch;
+        }
+
+        if (!globals.running) {
+            if (was_running) {
+                worker_drain(w);
+                was_running = FALSE;
+            }
+
+            // woken by loadgen_wake(), epoch above is looked at again on the way
+            pthread_mutex_lock(&idle_mutex);
+            if (!globals.running) {
+                pthread_cond_wait(&idle_cond, &idle_mutex);
+            }
+            pthread_mutex_unlock(&idle_mutex);
+            continue;
+        }
+
+        if (!was_running) {
+            for (int i = 0; i < w->nconns; i++) {
+                conn_refresh(&w->conns[i]);
+            }
+            was_running = TRUE;
+        }
+
+        u64 wake = worker_send(w, now_us());
+        worker_poll(w, wake);
+    }
+
+    return NULL;
+}
+
+// ======================================================================================
+// Base
+// ======================================================================================
+
+// load generator runs requests instead of main loop only when asked for more than one connection or endpoint
+int
+loadgen_active(void) {
+    return nconns > 0 && uplink_kind(globals.cxt.protocol) != UPLINK_SERIAL;
+}
+
+int
+loadgen_init(global_t *global) {
+    if (global->connections <= 1 && global->workers <= 1 && !global->fleet_len &&
+        global->backend == IO_BACKEND_EPOLL) {
+        return RC_SUCCESS;
+    }
+
+    ntargets     = 1 + global->fleet_len;
+    per_endpoint = CLAMP(global->connections, 1, MAX_VAL(LOADGEN_MAX_CONNS / ntargets, 1));
+    nconns       = MIN_VAL(ntargets * per_endpoint, LOADGEN_MAX_CONNS);
+    nworkers     = CLAMP(global->workers, 1, MIN_VAL(nconns, LOADGEN_MAX_WORKERS));
+
+    // statistic of each connection takes whole cache lines, workers don't share them
+    conns   = aligned_alloc(STATS_LINE, nconns * sizeof(conn_t));
+    workers = aligned_alloc(STATS_LINE, nworkers * sizeof(worker_t));
+    if (!conns || !workers) {
+        log_line("! failed to allocate load generator");
+        nconns = 0;
+        return RC_FAIL;
+    }
+    memset(conns, 0, nconns * sizeof(conn_t));
+    memset(workers, 0, nworkers * sizeof(worker_t));
+
+    for (int i = 0; i < nconns; i++) {
+        conn_t *c = &conns[i];
+
+        // connections of one endpoint go one after another
+        int target = i / per_endpoint;
+
+        c->id     = i;
+        c->target = target ? &global->fleet[target - 1] : &global->tcp_endp;
+        c->cxt    = global->cxt;
+        c->cxt.fd = -1;
+        c->ep_fd  = -1;
+        link_init(&c->link, c->target);
+        link_init(&c->standby, c->target);
+        pipe_init(&c->pipe, &c->cxt, &c->stats, global->pipeline);
+        if (global->sched_mode == SCHED_SCAN && !scan_init(&c->scan, global->plan, &c->stats)) {
+            log_linef("! failed to allocate scan table");
+            nconns = 0;
+            return RC_FAIL;
+        }
+        snprintf(c->name, sizeof(c->name), "%s:%d", c->target->host, c->target->tcp_port);
+        c->pipe.name = ntargets > 1 ? c->name : NULL;
+    }
+
+    // spread connections over workers as even as possible
+    int per_worker = nconns / nworkers;
+    int extra      = nconns % nworkers;
+    int first      = 0;
+    for (int i = 0; i < nworkers; i++) {
+        worker_t *w = &workers[i];
+
+        w->id     = i;
+        w->conns  = &conns[first];
+        w->nconns = per_worker + (i < extra);
+        first    += w->nconns;
+        for (int j = 0; j < w->nconns; j++) {
+            w->conns[j].pipe.latency   = &w->latency;
+            w->conns[j].pipe.corrected = &w->corrected;
+        }
+
+        w->epfd = -1;
+        if (global->backend == IO_BACKEND_URING) {
+            w->ring = malloc(sizeof(uring_t));
+            if (!w->ring || uring_init(w->ring) != RC_SUCCESS) {
+                log_linef("! io_uring is not available: %s, falling back to epoll", strerror(errno));
+                free(w->ring);
+                w->ring         = NULL;
+                global->backend = IO_BACKEND_EPOLL;
+            }
+        }
+
+        w->epfd = w->ring ? -1 : epoll_create1(EPOLL_CLOEXEC);
+        if (!w->ring && w->epfd < 0) {
+            log_linef("! failed to create epoll: %s", strerror(errno));
+            nconns = 0;
+            return RC_FAIL;
+        }
+
+        // io_uring waits with us precision by itself
+        w->tfd = -1;
+        if (!w->ring && (sched_open_loop(global->sched_mode) || global->sched_mode == SCHED_SCAN)) {
+            struct epoll_event ev = {.events = EPOLLIN, .data.ptr = NULL};
+
+            w->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+            if (w->tfd >= 0 && epoll_ctl(w->epfd, EPOLL_CTL_ADD, w->tfd, &ev) < 0) {
+                close(w->tfd);
+                w->tfd = -1;
+            }
+        }
+
+        pthread_create(&w->thread, NULL, worker_thread, w);
+    }
+
+    if (ntargets > 1) {
+        log_linef("> fleet: %d endpoints, %d connections each", ntargets, per_endpoint);
+    }
+    log_linef("> load generator: %d connections over %d workers (%s)", nconns, nworkers,
+      global->backend == IO_BACKEND_URING ? "io_uring" : "epoll");
+    return RC_SUCCESS;
+}
+
+// sum of all connections' statistic
+void
+loadgen_stats(statistic_t *out) {
+    for (int i = 0; i < nconns; i++) {
+        stats_read(out, &conns[i].stats);
+    }
+}
+
+// merge response time histograms of all workers, raw and corrected for coordinated omission
+void
+loadgen_latency(hist_t *out, hist_t *corrected) {
+    for (int i = 0; i < nworkers; i++) {
+        hist_read(out, &workers[i].latency);
+        hist_read(corrected, &workers[i].corrected);
+    }
+}
+
+// add requests sent and late of all connections, time of the run is kept by caller
+void
+loadgen_sched(sched_t *out) {
+    if (!loadgen_active()) {
+        return;
+    }
+
+    for (int i = 0; i < nconns; i++) {
+        out->issued += conns[i].sched.issued;
+        out->late   += conns[i].sched.late;
+    }
+}
+
+// add scan group statistic of all connections, one item per group
+void
+loadgen_scan(scan_stat_t *out) {
+    if (!loadgen_active()) {
+        return;
+    }
+
+    for (int i = 0; i < nconns; i++) {
+        scan_add(out, &conns[i].scan);
+    }
+}
+
+// number of endpoints and how many of them have at least one connection open
+int
+loadgen_endpoints(int *up) {
+    *up = 0;
+
+    for (int t = 0; t < ntargets; t++) {
+        for (int i = t * per_endpoint; i < MIN_VAL((t + 1) * per_endpoint, nconns); i++) {
+            if (conns[i].cxt.fd >= 0) {
+                (*up)++;
+                break;
+            }
+        }
+    }
+
+    return ntargets;
+}
+
+// run could be started or statistic reset, idle workers have to look at it
+void
+loadgen_wake(void) {
+    pthread_mutex_lock(&idle_mutex);
+    pthread_cond_broadcast(&idle_cond);
+    pthread_mutex_unlock(&idle_mutex);
+}
+
+void
+loadgen_log_stats(void) {
+    if (!nconns) {
+        log_line("> load generator is off");
+        return;
+    }
+
+    if (ntargets > 1) {
+        log_line("> per endpoint statistic:");
+        for (int t = 0; t < ntargets; t++) {
+            statistic_t sum  = {0};
+            int         open = 0;
+            int         last = MIN_VAL((t + 1) * per_endpoint, nconns);
+
+            for (int i = t * per_endpoint; i < last; i++) {
+                stats_read(&sum, &conns[i].stats);
+                open += conns[i].cxt.fd >= 0;
+            }
+
+            log_linef("  %-21s (%d/%d up): requests %lu, success %lu, fails %lu, timeouts %lu", conns[t * per_endpoint].name,
+              open, last - t * per_endpoint, sum.requests, sum.success, sum.fails, sum.timeouts);
+        }
+    }
+
+    log_line("> per connection statistic:");
+    for (int i = 0; i < nworkers; i++) {
+        worker_t *w        = &workers[i];
+        u64       requests = 0;
+        u64       syscalls = __atomic_load_n(w->ring ? &w->ring->enters : &w->syscalls, __ATOMIC_RELAXED);
+
+        for (int j = 0; j < w->nconns; j++) {
+            statistic_t s = {0};
+            stats_read(&s, &w->conns[j].stats);
+            requests += s.requests;
+        }
+
+        log_linef("  worker %02d (%s): %lu syscalls, %.2f per request", w->id, w->ring ? "io_uring" : "epoll", syscalls,
+          requests ? (double)syscalls / requests : 0.0);
+
+        for (int j = 0; j < w->nconns; j++) {
+            conn_t     *c = &w->conns[j];
+            statistic_t s = {0};
+            char        state[32];
+            stats_read(&s, &c->stats);
+
+            if (uplink_kind(c->cxt.protocol) == UPLINK_DGRAM) {
+                snprintf(state, sizeof(state), "udp");
+            } else {
+                link_str_state(&c->link, state, sizeof(state));
+            }
+            log_linef("  conn %04d (worker %02d, fd %d, %s, %u connects, %u failed): requests %lu, success %lu, "
+                      "fails %lu, timeouts %lu",
+              c->id, w->id, c->cxt.fd, state, c->link.connects, c->link.failures, s.requests, s.success, s.fails,
+              s.timeouts);
+        }
+    }
+}
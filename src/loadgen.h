@@ -0,0 +1,72 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <pthread.h>
+
+#include "client_cxt.h"
+#include "link.h"
+#include "pipeline.h"
+#include "scan.h"
+#include "sched.h"
+#include "uring.h"
+
+#define LOADGEN_MAX_CONNS   4096
+#define LOADGEN_MAX_WORKERS 64
+#define LOADGEN_REDRAW_MS   100 // how often header is redrawn while load generator runs
+#define LOADGEN_TX_LEN      (4 * MB_TCP_MAX_ADU_LEN)
+#define LOADGEN_UDP_BATCH   32 // datagrams sent or received with one sendmmsg/recvmmsg
+
+// one of load generator tcp connections, has its own tid space and statistic
+typedef struct conn {
+    int id;
+
+    client_cxt_t cxt;
+    statistic_t  stats;
+    pipeline_t   pipe;
+
+    tcp_endp *target;       // endpoint connection should be opened to
+    link_t    link;         // connection to target, cxt.fd is its fd while it is up
+    link_t    standby;      // --standby: spare connection to take over when link drops
+    char      name[24];     // host:port for log
+    int       ep_fd;        // fd watched by worker (epoll or io_uring)
+    int       ep_connect;   // ep_fd is watched for connect to finish, not for data
+    sched_t   sched;        // when the next request is due
+    scan_t    scan;         // --plan scan groups: deadlines of every group
+
+    // io_uring and udp: requests are staged and sent in one go, kernel owns tx until send completes
+    u16 gen; // bumped every time fd changes, completions of older fds are dropped
+    u8  tx[LOADGEN_TX_LEN];
+    int tx_len;
+    int tx_busy;                     // sends submitted and not completed yet
+    u16 tx_dgram[LOADGEN_UDP_BATCH]; // udp: length of every datagram staged in tx
+    int tx_count;                    // udp: datagrams staged in tx
+} conn_t;
+
+typedef struct worker {
+    int       id;
+    pthread_t thread;
+    int       epfd;
+    uring_t  *ring; // NULL - epoll backend
+    int       tfd;  // epoll open loop: timer to wake up at request due time, epoll_wait sleeps in whole ms
+
+    u64 syscalls; // epoll backend, io_uring counts its own enters
+    u32 epoch;    // statistic reset syscall counters belong to
+
+    hist_t latency;   // response time of all its connections
+    hist_t corrected; // and the same corrected for coordinated omission
+
+    conn_t *conns;
+    int     nconns;
+} worker_t;
+
+int  loadgen_init(global_t *global);
+int  loadgen_active(void);
+void loadgen_stats(statistic_t *out);
+void loadgen_latency(hist_t *out, hist_t *corrected);
+void loadgen_sched(sched_t *out);
+void loadgen_scan(scan_stat_t *out);
+void loadgen_log_stats(void);
+void loadgen_wake(void);
+int  loadgen_endpoints(int *up);
+
+#endif
@@ -0,0 +1,126 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "logq.h"
+#include "types.h"
+
+// every thread which logs gets its own queue on the first record, consumer walks all of them
+static logq_t *queues[LOGQ_THREADS];
+static int     nqueues;
+static u64     orphans; // records of threads which got no queue
+
+static __thread logq_t *own;
+
+static logq_t *
+logq_own(void) {
+    if (own) {
+        return own;
+    }
+
+    int i = __atomic_fetch_add(&nqueues, 1, __ATOMIC_RELAXED);
+    if (i >= LOGQ_THREADS) {
+        __atomic_store_n(&nqueues, LOGQ_THREADS, __ATOMIC_RELAXED);
+        return NULL;
+    }
+
+    logq_t *q = aligned_alloc(STATS_LINE, sizeof(logq_t));
+    if (q) {
+        memset(q, 0, sizeof(logq_t));
+    }
+    // consumer skips slot until it is published
+    __atomic_store_n(&queues[i], q, __ATOMIC_RELEASE);
+    own = q;
+    return q;
+}
+
+static int
+logq_size(int endp_len, int len) {
+    int size = sizeof(logq_rec_t) + endp_len + len;
+    return (size + LOGQ_ALIGN - 1) & ~(LOGQ_ALIGN - 1);
+}
+
+// ======================================================================================
+// Producer
+
+// copy record into queue of calling thread, it is dropped and counted if there is no room,
+// so logging never waits for render
+int
+logq_push(u8 kind, u8 ds, const char *endp, const void *data, int len) {
+    logq_t *q = logq_own();
+    if (!q) {
+        __atomic_add_fetch(&orphans, 1, __ATOMIC_RELAXED);
+        return RC_FAIL;
+    }
+
+    int endp_len = endp ? strnlen(endp, 255) : 0;
+    int size     = logq_size(endp_len, len);
+    u64 head     = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    int at       = q->tail & (LOGQ_LEN - 1);
+    int to_end   = LOGQ_LEN - at;
+    int need     = size > to_end ? size + to_end : size;
+
+    if (size > LOGQ_LEN / 2 || q->tail + need - head > LOGQ_LEN) {
+        __atomic_store_n(&q->dropped, q->dropped + 1, __ATOMIC_RELAXED);
+        return RC_FAIL;
+    }
+
+    // record is never split, the end of buffer is padded and it goes from the start
+    if (size > to_end) {
+        logq_rec_t *pad = (logq_rec_t *)&q->buf[at];
+        *pad            = (logq_rec_t){.kind = LOGQ_PAD, .len = to_end - sizeof(logq_rec_t)};
+        at              = 0;
+    }
+
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+
+    logq_rec_t *rec = (logq_rec_t *)&q->buf[at];
+    *rec = (logq_rec_t){.us = tv.tv_sec * 1000000ull + tv.tv_usec, .len = len, .kind = kind, .ds = ds, .endp_len = endp_len};
+    memcpy(&q->buf[at + sizeof(logq_rec_t)], endp, endp_len);
+    memcpy(&q->buf[at + sizeof(logq_rec_t) + endp_len], data, len);
+
+    __atomic_store_n(&q->tail, q->tail + need, __ATOMIC_RELEASE);
+    return RC_SUCCESS;
+}
+
+// ======================================================================================
+// Consumer
+
+int
+logq_count(void) {
+    return MIN_VAL(__atomic_load_n(&nqueues, __ATOMIC_RELAXED), LOGQ_THREADS);
+}
+
+// NULL - queue is being set up or thread failed to allocate it
+logq_t *
+logq_at(int i) {
+    return __atomic_load_n(&queues[i], __ATOMIC_ACQUIRE);
+}
+
+u64
+logq_orphans(void) {
+    return __atomic_load_n(&orphans, __ATOMIC_RELAXED);
+}
+
+// oldest record of queue, NULL - empty
+logq_rec_t *
+logq_peek(logq_t *q) {
+    u64 tail = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+
+    while (q->head != tail) {
+        logq_rec_t *rec = (logq_rec_t *)&q->buf[q->head & (LOGQ_LEN - 1)];
+        if (rec->kind != LOGQ_PAD) {
+            return rec;
+        }
+        __atomic_store_n(&q->head, q->head + sizeof(logq_rec_t) + rec->len, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+}
+
+void
+logq_pop(logq_t *q) {
+    logq_rec_t *rec = (logq_rec_t *)&q->buf[q->head & (LOGQ_LEN - 1)];
+    __atomic_store_n(&q->head, q->head + logq_size(rec->endp_len, rec->len), __ATOMIC_RELEASE);
+}
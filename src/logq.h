@@ -0,0 +1,41 @@
+#ifndef LOGQ_H
+#define LOGQ_H
+
+#include "stats.h"
+#include "types.h"
+
+#define LOGQ_LEN     (1 << 16) // power of 2, bytes of records one thread can have waiting for render
+#define LOGQ_ALIGN   16        // records start on it, so padding at the end of buffer always fits header
+#define LOGQ_THREADS 80        // load generator workers, main loop, tui and spare
+
+#define LOGQ_PAD 0 // kind of record which fills the end of buffer, consumer skips it
+
+// log record: header, endpoint name, data
+typedef struct logq_rec {
+    u64 us;       // wall clock, when it happened
+    u16 len;      // bytes of data
+    u8  kind;     // what data is, up to the consumer
+    u8  ds;       // traffic direction and status
+    u8  endp_len; // endpoint name before data, 0 - current endpoint
+    u8  pad[3];
+} logq_rec_t;
+
+// single producer single consumer ring, producer is the thread which owns it, head and tail run freely
+typedef struct logq {
+    u64 tail;    // next byte to write, only producer moves it
+    u64 dropped; // records which didn't fit
+    u64 head __attribute__((aligned(STATS_LINE))); // next record to read, only consumer moves it
+    u8  buf[LOGQ_LEN] __attribute__((aligned(STATS_LINE)));
+} logq_t;
+
+int         logq_push(u8 kind, u8 ds, const char *endp, const void *data, int len);
+int         logq_count(void);
+logq_t     *logq_at(int i);
+u64         logq_orphans(void);
+logq_rec_t *logq_peek(logq_t *q);
+void        logq_pop(logq_t *q);
+
+#define LOGQ_ENDP(rec) ((const char *)(rec) + sizeof(logq_rec_t))
+#define LOGQ_DATA(rec) ((const u8 *)(rec) + sizeof(logq_rec_t) + (rec)->endp_len)
+
+#endif
@@ -1,4 +1,5 @@
 #include <errno.h>
+#include <limits.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
@@ -9,103 +10,134 @@
 #include <unistd.h>
 
 #include "client_cxt.h"
+#include "discover.h"
 #include "helping_hand.h"
+#include "loadgen.h"
 #include "mb_base.h"
+#include "pipeline.h"
+#include "plan.h"
+#include "profile.h"
+#include "request.h"
+#include "rx_ring.h"
+#include "scan.h"
+#include "sched.h"
+#include "tstamp.h"
 #include "tui.h"
 #include "types.h"
 #include "uplink.h"
 
 global_t globals = {0};
 
-// -------------------- Request section ---------------------------------------------------
+static pipeline_t tcp_pipe;
+static scan_t     main_scan; // --plan scan groups of main loop
 
-int
-build_wdata_bits(func_cxt_t *fcxt, u8 data[MB_MAX_WRITE_BITS]) {
-    int to_write = CLAMP(globals.cxt.wcount, 0, MB_MAX_WRITE_BITS);
-    fcxt->wcount = to_write;
+// bytes read from uplink which are not framed yet, valid only for rx_fd
+static rx_ring_t uplink_rx;
+static int       rx_fd = -1;
 
-    if (globals.random) {
-        for (int i = 0; i < to_write; i++) {
-            data[i] = rand() % 2;
-        }
-    } else {
-        to_write = CLAMP(to_write, 0, WD_MAX_LEN);
-        for (int i = 0; i < to_write; i++) {
-            // write what we have, everything else will be 0
-            data[i] = globals.cxt.wdata[i];
-        }
-    }
+// --timestamping: kernel timestamps of the current request and when user space sent it and got response
+static tstamp_t ts_tx;
+static tstamp_t ts_rx;
+static u64      ts_sent_ns;
+static u64      ts_rcvd_ns;
+
+// response timeout of the current request and estimator of its slave
+static u32    rsp_timeout_us;
+static rto_t *rsp_rto;
+static u64    req_intended_us; // open loop: when request being sent was due, 0 - when it is sent
+static u64    rsp_intended_us;
+
+// -------------------- Timestamping ------------------------------------------------------
+
+static int
+timestamping_on(void) {
+    return globals.timestamping && uplink_kind(globals.cxt.protocol) != UPLINK_SERIAL;
 }
 
-int
-build_wdata_regs(func_cxt_t *fcxt, u8 data[MB_MAX_WRITE_BITS]) {
-    int  fflags    = fc_flags(fcxt->fc);
-    int  max_write = fflags & FCF_READ ? MB_MAX_WR_WRITE_REGS : MB_MAX_WRITE_REGS;
-    u16 *write     = (void *)data;
+// read() which also takes kernel rx timestamp of what was read
+static int
+uplink_read(u8 *buf, int len, int flags) {
+    if (!timestamping_on()) {
+        return recv(globals.cxt.fd, buf, len, flags);
+    }
 
-    int to_write = CLAMP(globals.cxt.wcount, 0, max_write);
-    fcxt->wcount = to_write;
+    int rc     = tstamp_recv(globals.cxt.fd, buf, len, flags, &ts_rx);
+    ts_rcvd_ns = now_ns();
+    if (rc < 0 && errno == EAGAIN) {
+        // woken up by tx timestamp in error queue, not by data
+        tstamp_drain_tx(globals.cxt.fd, &ts_tx);
+        errno = EAGAIN;
+    }
 
-    if (globals.random) {
-        for (int i = 0; i < to_write; i++) {
-            write[i] = rand() % 0xFFFF;
-        }
-    } else {
-        for (int i = 0; i < to_write; i++) {
-            // write what we have, everything else will be 0
-            write[i] = globals.cxt.wdata[i];
-        }
+    return rc;
+}
+
+// wire latency is from the moment request left the host till response came to it,
+// the rest of what user space saw is our own overhead
+static void
+count_latency() {
+    tstamp_drain_tx(globals.cxt.fd, &ts_tx);
+
+    u64 user = ts_rcvd_ns - ts_sent_ns;
+    if (!ts_tx.ns || !ts_rx.ns || ts_tx.hw != ts_rx.hw || ts_rx.ns < ts_tx.ns) {
+        log_linef("  latency: user %lu ns, no kernel timestamps", user);
+        return;
     }
+
+    u64 wire = ts_rx.ns - ts_tx.ns;
+
+    STAT_ADD(&globals.stats, wire_sum_ns, wire);
+    STAT_MAX(&globals.stats, wire_max_ns, wire);
+    STAT_ADD(&globals.stats, user_sum_ns, user);
+    STAT_INC(&globals.stats, wire_count);
+
+    log_linef("  latency: wire %lu ns (%s), user %lu ns, client overhead %ld ns", wire, ts_rx.hw ? "hw" : "sw", user,
+      (long)(user - wire));
 }
 
+// -------------------- Request section ---------------------------------------------------
+
 int
 send_request(frame_t *frame) {
-    func_cxt_t fcxt = {
-      .fc = globals.cxt.fc,
-    };
-    // can't write anything more than that anyway
-    u8 wdata[MB_MAX_WRITE_BITS] = {0};
-
-    // build data for request
-    int fflag = fc_flags(fcxt.fc);
-    if (fflag & FCF_READ) {
-        fcxt.raddress = globals.cxt.raddress;
-        fcxt.rcount   = globals.cxt.rcount;
-    }
-    if (fflag & FCF_WRITE) {
-        fcxt.waddress = globals.cxt.waddress;
-        if (fflag & FCF_BITS) {
-            build_wdata_bits(&fcxt, wdata);
-        } else {
-            build_wdata_regs(&fcxt, wdata);
-        }
-    }
-
-    // build pdu
-    int pdu_len = build_pdu(frame->pdu, wdata, fcxt);
-    if (pdu_len > 0) {
-        frame->pdu_len = pdu_len;
-    } else {
+    int adu_len = 0;
+    u8 *adu     = request_adu(&globals.cxt, frame, &adu_len);
+    if (!adu) {
         return RC_FAIL;
     }
 
-    // build adu
-    u8 adu[MB_MAX_ADU_LEN] = {0};
+    // without tid there is no way to match leftovers to request, clear them before
+    // request goes out, after it fast slave's response would be flushed too
+    if (mb_framing(frame->protocol) != MB_PROTOCOL_TCP) {
+        rx_reset(&uplink_rx);
+        if (uplink_kind(frame->protocol) == UPLINK_SERIAL) {
+            tcflush(globals.cxt.fd, TCIFLUSH);
+        }
+    }
 
-    int adu_len = build_adu(adu, frame);
-    if (adu_len <= 0) {
-        return RC_FAIL;
+    if (timestamping_on()) {
+        // timestamps of previous request are of no use
+        tstamp_drain_tx(globals.cxt.fd, &ts_tx);
+        memset(&ts_tx, 0, sizeof(ts_tx));
+        memset(&ts_rx, 0, sizeof(ts_rx));
     }
 
     // try write to fd
-    globals.stats.requests++;
+    STAT_INC(&globals.stats, requests);
+
+    rsp_rto        = &globals.cxt.rto[frame->uid];
+    rsp_timeout_us = rto_timeout_us(rsp_rto, &globals.cxt.rto_link);
+
+    // response timeout and latency count from here, logging below is not slave's time
+    globals.time_start = now_us();
+    ts_sent_ns         = now_ns();
+    rsp_intended_us    = req_intended_us ? MIN_VAL(req_intended_us, globals.time_start) : globals.time_start;
+
     int bytes_send = write(globals.cxt.fd, adu, adu_len);
     /* it's my homie, mr. write*/
 
-    // clear all pesky leftovers
-    tcflush(globals.cxt.fd, TCIFLUSH);
 
     if (bytes_send > 0) {
+        STAT_ADD(&globals.stats, bytes_out, bytes_send);
         log_adu(adu, adu_len, frame->protocol, DS_OUT_OK);
         return RC_SUCCESS;
     } else if (errno == EPIPE || errno == ENOTTY) {
@@ -125,36 +157,189 @@ send_request(frame_t *frame) {
 
 // -------------------- Response section --------------------------------------------------
 
+static void
+count_timeout(u64 deadline) {
+    u64 now       = now_us();
+    u32 overshoot = now - deadline;
+
+    // stall of slave is what correction is for, request given up on counts as answered just now
+    hist_record_co(&globals.corrected, now - rsp_intended_us, sched_backfill_us(&globals.sched));
+
+    STAT_ADD(&globals.stats, overshoot_sum_us, overshoot);
+    STAT_MAX(&globals.stats, overshoot_max_us, overshoot);
+
+    log_traffic_str("timed out", DS_IN_FAIL);
+    STAT_INC(&globals.stats, timeouts);
+    rto_expired(rsp_rto);
+}
+
+// rtu frame ends with t3.5 of silence, bytes are timestamped as they come to measure gaps inside frame
+int
+read_rtu_timed(u8 out[MB_MAX_ADU_LEN], int *out_len) {
+    u64 deadline = globals.time_start + rsp_timeout_us;
+    u32 char_us  = serial_char_us(&globals.sconf);
+    u32 t15      = 0;
+    u32 t35      = 0;
+    serial_char_times(&globals.sconf, &t15, &t35);
+
+    int pos     = 0;
+    int dropped = 0;
+    u64 last    = 0;
+    u32 gap_max = 0;
+
+    while (1) {
+        // before first byte wait for response timeout, after it - for the end of frame
+        int rc = uplink_wait_readable(globals.cxt.fd, pos ? last + t35 : deadline);
+        if (rc == RC_FAIL) {
+            if (pos) {
+                break;
+            }
+
+            count_timeout(deadline);
+            return RC_FAIL;
+        } else if (rc == RC_ERROR) {
+            log_linef("! failed to wait for response: %s", strerror(errno));
+            STAT_INC(&globals.stats, fails);
+            return RC_FAIL;
+        }
+
+        u8  chunk[MB_MAX_ADU_LEN];
+        int add = read(globals.cxt.fd, chunk, sizeof(chunk));
+        u64 now = now_us();
+        if (add < 0 && (errno == EAGAIN || errno == EINTR)) {
+            continue;
+        } else if (add <= 0) {
+            // readable, but nothing to read or error: device is gone (usb adapter unplugged and alike)
+            log_linef("! failed to read response: %s", add ? strerror(errno) : "device closed");
+            STAT_INC(&globals.stats, fails);
+
+            close(globals.cxt.fd);
+            globals.cxt.fd = -1;
+            return RC_FAIL;
+        }
+
+        // silence before chunk is time since the previous one minus time chunk itself took on the wire
+        if (pos) {
+            u64 wire = (u64)add * char_us;
+            u32 gap  = now - last > wire ? now - last - wire : 0;
+            gap_max  = MAX_VAL(gap_max, gap);
+        }
+        last = now;
+
+        int fit = MIN_VAL(add, MB_MAX_ADU_LEN - pos);
+        memcpy(&out[pos], chunk, fit);
+        pos     += fit;
+        dropped += add - fit;
+    }
+
+    STAT_MAX(&globals.stats, gap_max_us, gap_max);
+
+    if (dropped) {
+        log_traffic_str("frame is too long", DS_IN_FAIL);
+        STAT_INC(&globals.stats, fails);
+        return RC_FAIL;
+    } else if (gap_max > t15) {
+        // spec says such frame has to be discarded
+        log_traffic_str("inter-char gap longer than t1.5", DS_IN_FAIL);
+        STAT_INC(&globals.stats, gap_violations);
+        STAT_INC(&globals.stats, fails);
+        return RC_FAIL;
+    }
+
+    *out_len = pos;
+    return RC_SUCCESS;
+}
+
+// wait for the next complete adu, bytes which came after it are kept for the next call
 int
 read_nonblock(u8 out[MB_MAX_ADU_LEN], int *out_len) {
-    u32 pos                  = 0;
-    u8  buff[MB_MAX_ADU_LEN] = {0};
-    int temp_len             = 0;
-    u16 expected             = 0;
+    u64 deadline = globals.time_start + rsp_timeout_us;
+
+    // connection was reopened, old bytes belong to the old one
+    if (rx_fd != globals.cxt.fd) {
+        rx_reset(&uplink_rx);
+        rx_fd = globals.cxt.fd;
+    }
 
     while (1) {
-        expected = mb_get_expected_adu_len(globals.cxt.protocol, out, pos, MB_DIR_RESPONSE);
-        if (expected < 0) {
+        int adu_len = rx_next_adu(&uplink_rx, globals.cxt.protocol, MB_DIR_RESPONSE, out);
+        if (adu_len > 0) {
+            *out_len = adu_len;
+            return RC_SUCCESS;
+        } else if (adu_len < 0) {
+            log_traffic_str("garbage in stream", DS_IN_FAIL);
+            continue;
+        }
+
+        // sleep until something arrives instead of spinning on read
+        int rc = uplink_wait_readable(globals.cxt.fd, deadline);
+        if (rc == RC_FAIL) {
+            count_timeout(deadline);
+            return RC_FAIL;
+        } else if (rc == RC_ERROR) {
+            log_linef("! failed to wait for response: %s", strerror(errno));
+            STAT_INC(&globals.stats, fails);
             return RC_FAIL;
-        } else if (expected == 0) {
-            expected = MB_MAX_ADU_LEN;
         }
 
-        int add = read(globals.cxt.fd, &out[pos], expected - pos);
+        // take everything available with one read, not just expected length
+        int room = 0;
+        u8 *dst  = rx_write_ptr(&uplink_rx, &room);
+
+        int add = uplink_kind(globals.cxt.protocol) == UPLINK_SERIAL ? read(globals.cxt.fd, dst, room)
+                                                                      : uplink_read(dst, room, 0);
         if (add > 0) {
-            pos += add;
-        }
+            rx_produce(&uplink_rx, add);
+        } else if (add == 0) {
+            // readable, but nothing to read: other side closed connection
+            log_traffic_str("connection closed by peer", DS_IN_FAIL);
+            STAT_INC(&globals.stats, fails);
+
+            close(globals.cxt.fd);
+            globals.cxt.fd = -1;
+            return RC_FAIL;
+        } else if (add < 0 && errno != EAGAIN && errno != EINTR) {
+            // usb adapter unplugged, connection reset and alike, poll keeps waking up on them
+            log_linef("! failed to read response: %s", strerror(errno));
+            STAT_INC(&globals.stats, fails);
 
-        if (now_ms() - globals.time_start > globals.response_timeout) {
-            log_traffic_str("timed out", DS_IN_FAIL);
-            globals.stats.timeouts++;
+            close(globals.cxt.fd);
+            globals.cxt.fd = -1;
             return RC_FAIL;
         }
+    }
+}
+
+// every datagram is one whole adu, nothing carries over to the next one
+int
+read_dgram(u8 out[MB_MAX_ADU_LEN], int *out_len) {
+    u64 deadline = globals.time_start + rsp_timeout_us;
 
-        if (pos >= expected) {
-            *out_len = pos;
+    while (1) {
+        int rc = uplink_wait_readable(globals.cxt.fd, deadline);
+        if (rc == RC_FAIL) {
+            count_timeout(deadline);
+            return RC_FAIL;
+        } else if (rc == RC_ERROR) {
+            log_linef("! failed to wait for response: %s", strerror(errno));
+            STAT_INC(&globals.stats, fails);
+            return RC_FAIL;
+        }
 
+        // MSG_TRUNC: length of the whole datagram, so oversized one is not taken as valid
+        int add = uplink_read(out, MB_MAX_ADU_LEN, MSG_TRUNC);
+        if (add > MB_MAX_ADU_LEN) {
+            log_traffic_str("datagram is too long", DS_IN_FAIL);
+            STAT_INC(&globals.stats, fails);
+            return RC_FAIL;
+        } else if (add > 0) {
+            *out_len = add;
             return RC_SUCCESS;
+        } else if (add < 0 && errno == ECONNREFUSED) {
+            // icmp port unreachable, nobody listens there
+            log_traffic_str("port unreachable", DS_IN_FAIL);
+            STAT_INC(&globals.stats, fails);
+            return RC_FAIL;
         }
     }
 }
@@ -164,9 +349,19 @@ recv_response(frame_t *req_frame) {
     u8  adu[MB_MAX_ADU_LEN] = {0};
     int adu_len             = 0;
 
-    if (!read_nonblock(adu, &adu_len)) {
+    int rc = FALSE;
+    if (globals.rtu_timing && req_frame->protocol == MB_PROTOCOL_RTU) {
+        rc = read_rtu_timed(adu, &adu_len);
+    } else if (uplink_kind(req_frame->protocol) == UPLINK_DGRAM) {
+        rc = read_dgram(adu, &adu_len);
+    } else {
+        rc = read_nonblock(adu, &adu_len);
+    }
+
+    if (!rc) {
         return RC_FAIL;
     }
+    STAT_ADD(&globals.stats, bytes_in, adu_len);
 
     int verr = mb_is_adu_valid(req_frame->protocol, adu, adu_len);
     if (verr == MB_VALIDATION_ERROR_OK) {
@@ -175,53 +370,218 @@ recv_response(frame_t *req_frame) {
 
         // can be response that we already count as 'timed out, try another
         if (req_frame->tid != rsp_frame.tid) {
+            char msg[48] = {0};
+            snprintf(msg, sizeof(msg), "late response (tid: %d)", rsp_frame.tid);
+            log_traffic_str(msg, DS_IN_FAIL);
+            STAT_INC(&globals.stats, late_responses);
             return recv_response(req_frame);
         }
 
+        // exception response tells how fast slave is as well
+        u64 now = now_us();
+        u32 rtt = now - globals.time_start;
+        rto_sample(rsp_rto, &globals.cxt.rto_link, rtt);
+        STAT_ADD(&globals.stats, rsp_sum_us, rtt);
+        STAT_INC(&globals.stats, rsp_count);
+        hist_record(&globals.latency, rtt);
+        hist_record_co(&globals.corrected, now - rsp_intended_us, sched_backfill_us(&globals.sched));
+
         if (check_req_rsp_pdu(req_frame->pdu, req_frame->pdu_len, rsp_frame.pdu, rsp_frame.pdu_len)) {
             log_adu(adu, adu_len, rsp_frame.protocol, DS_IN_OK);
-            globals.stats.success++;
+            STAT_INC(&globals.stats, success);
+            if (timestamping_on()) {
+                count_latency();
+            }
             return RC_SUCCESS;
         } else {
             log_adu(adu, adu_len, rsp_frame.protocol, DS_IN_FAIL);
-            globals.stats.fails++;
+            STAT_INC(&globals.stats, fails);
+            if (rsp_frame.pdu_len && rsp_frame.pdu[0] & 0x80) {
+                STAT_INC(&globals.stats, exceptions);
+            }
             return RC_FAIL;
         }
     } else {
-        globals.stats.fails++;
+        STAT_INC(&globals.stats, fails);
         log_traffic_str(str_valid_err(verr), DS_IN_FAIL);
     }
 }
 
-// -------------------- Base section ------------------------------------------------------
+// -------------------- Pacing ------------------------------------------------------------
 
-int
-make_request() {
-    u16 tid = 0;
-    if (globals.cxt.protocol == MB_PROTOCOL_TCP) {
-        tid = globals.cxt.tid++;
+// totals of the run over main loop and load generator connections
+static void
+run_totals(statistic_t *stats, sched_t *sched) {
+    stats_read(stats, &globals.stats);
+    loadgen_stats(stats);
+    *sched = globals.sched;
+    loadgen_sched(sched);
+}
+
+// --profile: close phases which are over and follow target rate, run ends with the last phase
+static void
+profile_watch(void) {
+    profile_t *p = globals.profile;
+    if (!p) {
+        return;
+    }
+
+    u64 elapsed = now_ns() - globals.sched.start_ns;
+    int phase   = 0;
+    globals.rate = profile_rate(p, elapsed, &phase);
+
+    while (p->done < phase) {
+        statistic_t stats = {0};
+        sched_t     sched = {0};
+        run_totals(&stats, &sched);
+        profile_close(p, p->done, elapsed, &stats, &sched);
+    }
+
+    if (phase == p->len) {
+        globals.running = FALSE;
+    }
+}
+
+// run started: main loop paces its own requests, load generator connections have their pacers
+// and main one only keeps time of the whole run
+static void
+run_start(void) {
+    u64 now    = now_ns();
+    u64 period = sched_period(globals.sched_mode, globals.rate, globals.timeout, 1);
+    sched_start(&globals.sched, globals.sched_mode, period, now, now);
+    tcp_pipe.backfill_us = sched_backfill_us(&globals.sched);
+    if (globals.profile) {
+        // requests sent are counted from 0 every run, statistic goes on from where it was
+        statistic_t stats = {0};
+        sched_t     sched = {0};
+        stats_read(&stats, &globals.stats);
+        loadgen_stats(&stats);
+        sched_profile(&globals.sched, globals.profile, 1);
+        profile_close(globals.profile, -1, 0, &stats, &sched);
+        globals.rate = globals.profile->phases[0].from;
+    }
+    if (globals.sched_mode == SCHED_SCAN) {
+        globals.cxt.plan.left = 0;
+        scan_start(&main_scan, now);
+    }
+}
+
+// summary of latency histogram and its dump if path is set
+static void
+run_latency(const char *name, const hist_t *h, const char *path) {
+    hist_sum_t sum = {0};
+    hist_summary(h, &sum);
+    log_linef("  %s: min %lu, mean %lu, p50 %lu, p90 %lu, p99 %lu, p99.9 %lu, max %lu us", name, sum.min, sum.mean,
+      sum.p50, sum.p90, sum.p99, sum.p999, sum.max);
+
+    if (!path) {
+        return;
+    }
+    if (hist_dump(h, path) == RC_SUCCESS) {
+        log_linef("> %s histogram of %lu samples written to %s", name, h->count, path);
+    } else {
+        log_linef("! failed to write histogram to %s: %s", path, strerror(errno));
     }
+}
+
+static void
+run_stop(void) {
+    sched_stop(&globals.sched, now_ns());
 
-    u8 uid = 1;
-    if (globals.sequence_uid) {
-        uid = globals.current_uid;
-        PIND_CLAMP(globals.current_uid, globals.slave_id_start, globals.slave_id_end);
+    sched_t sum = globals.sched;
+    loadgen_sched(&sum);
+
+    double secs = (sum.stop_ns - sum.start_ns) / 1e9;
+    if (sched_open_loop(sum.mode)) {
+        log_linef("> run: %lu requests in %.2f s, %.1f of %d req/s (%s), %lu late", sum.issued, secs,
+          sched_achieved(&sum, 0), globals.rate, str_sched(sum.mode), sum.late);
     } else {
-        uid = globals.slave_id_start;
+        log_linef("> run: %lu requests in %.2f s, %.1f req/s (%s)", sum.issued, secs, sched_achieved(&sum, 0),
+          str_sched(sum.mode));
+    }
+
+    statistic_t stats = {0};
+    stats_read(&stats, &globals.stats);
+    loadgen_stats(&stats);
+    log_linef("  traffic: %lu bytes out, %lu bytes in, %lu exceptions, %lu late responses", stats.bytes_out,
+      stats.bytes_in, stats.exceptions, stats.late_responses);
+
+    hist_t latency   = {0};
+    hist_t corrected = {0};
+    hist_read(&latency, &globals.latency);
+    hist_read(&corrected, &globals.corrected);
+    loadgen_latency(&latency, &corrected);
+    run_latency("response time", &latency, globals.histogram);
+
+    // the same file name with suffix, so plotter can put both on one chart
+    char path[PATH_MAX] = {0};
+    if (globals.histogram) {
+        snprintf(path, sizeof(path), "%s.corrected", globals.histogram);
+    }
+    run_latency("corrected", &corrected, globals.histogram ? path : NULL);
+
+    // estimates of main loop, load generator connections keep their own
+    for (int uid = 0; globals.adaptive_timeout && uid < 256; uid++) {
+        rto_t *r = &globals.cxt.rto[uid];
+        if (r->samples) {
+            log_linef("  uid %d: response time %u us, variance %u us, timeout %u us", uid, r->srtt_us, r->rttvar_us,
+              rto_timeout_us(r, &globals.cxt.rto_link));
+        } else if (r->misses) {
+            log_linef("  uid %d: silent, %u timeouts in a row", uid, r->misses);
+        }
+    }
+
+    // phase run was stopped in is summed up to this moment
+    profile_t *p = globals.profile;
+    if (p) {
+        if (p->done < p->len) {
+            statistic_t stats = {0};
+            sched_t     sched = {0};
+            run_totals(&stats, &sched);
+            profile_close(p, p->done, sum.stop_ns - sum.start_ns, &stats, &sched);
+        }
+        profile_log(p);
     }
 
-    frame_t frame = {
-      .protocol = globals.cxt.protocol,
-      .fc       = globals.cxt.fc,
-      .uid      = uid,
-      .tid      = tid,
-    };
+    if (sum.mode == SCHED_SCAN) {
+        scan_stat_t *groups = calloc(globals.plan->ngroups, sizeof(scan_stat_t));
+        if (groups) {
+            scan_add(groups, &main_scan);
+            loadgen_scan(groups);
+            scan_log(globals.plan, groups);
+            free(groups);
+        }
+    }
+}
+
+// wait until the next request is due, responses to pipelined requests are taken meanwhile
+static void
+wait_due(void) {
+    while (globals.running && !sched_due(&globals.sched, now_ns())) {
+        if (!tcp_pipe.count || !pipe_wait_until(&tcp_pipe, globals.sched.next_ns / 1000)) {
+            sched_sleep(&globals.sched);
+        }
+    }
+}
+
+// -------------------- Base section ------------------------------------------------------
+
+int
+make_request() {
+    // slave can queue requests, don't wait for each response before sending next one
+    if (mb_framing(globals.cxt.protocol) == MB_PROTOCOL_TCP && globals.pipeline > 1) {
+        int rc = pipe_request(&tcp_pipe);
+        redraw_header();
+        return rc;
+    }
+
+    frame_t frame = {0};
+    init_request_frame(&globals.cxt, &frame);
 
     if (send_request(&frame) != RC_SUCCESS) {
         return RC_FAIL;
     }
 
-    globals.time_start = now_ms();
     recv_response(&frame);
 
     // update statistic output
@@ -245,28 +605,98 @@ main(int argc, char *argv[]) {
 
     // before client is closed by any reason we must be sure that ncurses is
     // correctly finished, otherwise it will break user console
-    signal(SIGINT, exit_cleanup);
-    signal(SIGTERM, exit_cleanup);
+    sigset_t quit;
+    sigemptyset(&quit);
+    sigaddset(&quit, SIGINT);
+    sigaddset(&quit, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &quit, NULL); // every thread inherits it, tui render thread takes them
     signal(SIGSEGV, exit_cleanup);
     signal(SIGABRT, exit_cleanup);
 
     init_tui(&globals);
     log_line("Better Modbus Client v1.1");
     log_line("> tui started");
+    if (globals.plan) {
+        log_linef("> plan %s: %d steps", globals.plan->name, globals.plan->len);
+        if (globals.plan->wanted) {
+            log_linef("> plan %s: %u wanted items are read by %u requests", globals.plan->name,
+              globals.plan->wanted, globals.plan->coalesced);
+        }
+    }
 
     open_uplink(&globals);
     globals.cxt.last_run_was_on = globals.cxt.protocol;
 
+    pipe_init(&tcp_pipe, &globals.cxt, &globals.stats, globals.pipeline);
+    tcp_pipe.latency   = &globals.latency;
+    tcp_pipe.corrected = &globals.corrected;
+    if (globals.sched_mode == SCHED_SCAN && !scan_init(&main_scan, globals.plan, &globals.stats)) {
+        log_linef("! failed to allocate scan table");
+        globals.sched_mode = SCHED_INTERVAL;
+    }
+    loadgen_init(&globals);
+
     // must be after init_tui because of pointer to globals
     pthread_t tinput;
     pthread_create(&tinput, NULL, input_thread, NULL);
 
+    // bus is mapped before anything else is sent, then client goes on as usual
+    if (globals.discover) {
+        discover(&globals, globals.discover);
+        redraw_header();
+    }
+
+    u8 was_running = FALSE;
     while (1) {
         if (!globals.running) {
+            // let requests still in flight finish before going idle
+            if (tcp_pipe.count) {
+                pipe_drain(&tcp_pipe);
+                redraw_header();
+            }
+            if (was_running) {
+                run_stop();
+                was_running = FALSE;
+            }
+            // sleep until tui starts a run, keep connection ready for it meanwhile
+            uplink_idle(&globals, uplink_kind(globals.cxt.protocol) == UPLINK_STREAM &&
+                                    uplink_kind(globals.cxt.last_run_was_on) == UPLINK_STREAM && !loadgen_active());
             continue;
         }
 
-        if (globals.cxt.fd == -1) {
+        if (!was_running) {
+            run_start();
+            was_running = TRUE;
+        }
+
+        if (loadgen_active()) {
+            // workers do the requests, here we only watch fire sequence and keep header fresh
+            if (globals.rfire_count > 0 && globals.rfire_current >= globals.rfire_count) {
+                globals.running       = FALSE;
+                globals.rfire_count   = 0;
+                globals.rfire_current = 0;
+            }
+
+            profile_watch();
+            redraw_header();
+            msleep(LOADGEN_REDRAW_MS);
+            continue;
+        }
+
+        // make sure we run request on according connection
+        if (uplink_kind(globals.cxt.last_run_was_on) != uplink_kind(globals.cxt.protocol)) {
+            if (!relink(&globals)) {
+                globals.running = FALSE;
+            }
+        }
+
+        if (uplink_kind(globals.cxt.protocol) == UPLINK_STREAM) {
+            // connect or backoff in progress, don't stall the loop on it longer than one request period
+            if (!uplink_tcp_ready(&globals, now_us() + (u64)MAX_VAL(globals.timeout, 10) * 1000)) {
+                redraw_header();
+                continue;
+            }
+        } else if (globals.cxt.fd == -1) {
             // try reconnect just once
             if (!relink(&globals)) {
                 log_linef("! failed to reconnect: %s", strerror(errno));
@@ -274,24 +704,18 @@ main(int argc, char *argv[]) {
                 redraw_header();
                 continue;
             }
+        }
 
-            // wait small ammount of time to let new connection get ready
-            msleep(10);
+        profile_watch();
+        wait_due();
+        if (!globals.running) {
+            continue;
         }
 
-        // make sure we run request on according connection
-        if (globals.cxt.last_run_was_on == MB_PROTOCOL_TCP) {
-            if (globals.cxt.protocol == MB_PROTOCOL_RTU || globals.cxt.protocol == MB_PROTOCOL_ASCII) {
-                if (!relink(&globals)) {
-                    globals.running = FALSE;
-                }
-            }
-        } else {
-            if (globals.cxt.protocol == MB_PROTOCOL_TCP) {
-                if (!relink(&globals)) {
-                    globals.running = FALSE;
-                }
-            }
+        // scan table: nothing to poll yet if the deadline moved while waiting
+        if (globals.sched_mode == SCHED_SCAN && !scan_step(&main_scan, &globals.cxt.plan, now_ns())) {
+            globals.sched.next_ns = scan_next_ns(&main_scan, &globals.cxt.plan);
+            continue;
         }
 
         if (globals.rfire_count > 0) {
@@ -304,10 +728,15 @@ main(int argc, char *argv[]) {
             }
         }
 
+        req_intended_us      = sched_intended_us(&globals.sched);
+        tcp_pipe.intended_us = req_intended_us;
+        sched_take(&globals.sched, now_ns());
         make_request();
+        sched_done(&globals.sched, now_ns());
+        if (globals.sched_mode == SCHED_SCAN) {
+            globals.sched.next_ns = scan_next_ns(&main_scan, &globals.cxt.plan);
+        }
         globals.cxt.last_run_was_on = globals.cxt.protocol;
-
-        msleep(globals.timeout);
     }
 
     getchar();
@@ -15,6 +15,19 @@ str_protocol(mb_protocol_t protocol) {
     case MB_PROTOCOL_RTU: return "RTU";
     case MB_PROTOCOL_ASCII: return "ASCII";
     case MB_PROTOCOL_TCP: return "TCP";
+    case MB_PROTOCOL_UDP: return "UDP";
+    case MB_PROTOCOL_RTU_TCP: return "RTU over TCP";
+    default: return "unknown";
+    }
+}
+
+// frames are built and parsed the same way no matter what carries them
+mb_protocol_t
+mb_framing(mb_protocol_t protocol) {
+    switch (protocol) {
+    case MB_PROTOCOL_UDP: return MB_PROTOCOL_TCP;
+    case MB_PROTOCOL_RTU_TCP: return MB_PROTOCOL_RTU;
+    default: return protocol;
     }
 }
 
@@ -342,10 +355,11 @@ build_adu_tcp(u8 out_adu[MB_TCP_MAX_ADU_LEN], frame_t *frame) {
 
 int
 build_adu(u8 *adu, frame_t *frame) {
-    switch (frame->protocol) {
+    switch (mb_framing(frame->protocol)) {
     case MB_PROTOCOL_RTU: return build_adu_rtu(adu, frame);
     case MB_PROTOCOL_ASCII: return build_adu_ascii(adu, frame);
     case MB_PROTOCOL_TCP: return build_adu_tcp(adu, frame);
+    default: break; // mb_framing() maps udp and rtu over tcp to the above
     }
 
     return RC_FAIL;
@@ -605,10 +619,11 @@ mb_tcp_get_expected_adu_len(u8 *adu, int have) {
 
 int
 mb_get_expected_adu_len(mb_protocol_t proto, u8 *adu, int adu_len, mb_dir_t dir) {
-    switch (proto) {
+    switch (mb_framing(proto)) {
     case MB_PROTOCOL_RTU: return mb_rtu_get_expected_adu_len(adu, adu_len, dir);
     case MB_PROTOCOL_ASCII: return mb_ascii_get_expected_adu_len(adu, adu_len, dir);
     case MB_PROTOCOL_TCP: return mb_tcp_get_expected_adu_len(adu, adu_len);
+    default: break;
     }
     return -1;
 }
@@ -652,10 +667,11 @@ client_get_expected_rsp_adu_len(mb_protocol_t protocol, func_cxt_t *fcxt) {
         break;
     }
 
-    switch (protocol) {
+    switch (mb_framing(protocol)) {
     case MB_PROTOCOL_RTU: return uid + pdu_len + crc;
     case MB_PROTOCOL_ASCII: return ascii_head + pdu_len * 2 + crc + ascii_tail;
     case MB_PROTOCOL_TCP: return mbaph + pdu_len;
+    default: return -1;
     }
 }
 
@@ -696,10 +712,11 @@ mb_tcp_extract_frame(u8 *adu, int adu_len, frame_t *out) {
 
 void
 mb_extract_frame(mb_protocol_t proto, u8 *adu, int adu_len, frame_t *out) {
-    switch (proto) {
+    switch (mb_framing(proto)) {
     case MB_PROTOCOL_RTU: mb_rtu_extract_frame(adu, adu_len, out); break;
     case MB_PROTOCOL_ASCII: mb_ascii_extract_frame(adu, adu_len, out); break;
     case MB_PROTOCOL_TCP: mb_tcp_extract_frame(adu, adu_len, out); break;
+    default: break;
     }
 }
 
@@ -916,10 +933,11 @@ mb_tcp_is_adu_valid(u8 *adu, int len) {
 
 mb_validation_err_t
 mb_is_adu_valid(mb_protocol_t proto, u8 *adu, int adu_len) {
-    switch (proto) {
+    switch (mb_framing(proto)) {
     case MB_PROTOCOL_RTU: return mb_rtu_is_adu_valid(adu, adu_len);
     case MB_PROTOCOL_ASCII: return mb_ascii_is_adu_valid(adu, adu_len);
     case MB_PROTOCOL_TCP: return mb_tcp_is_adu_valid(adu, adu_len);
+    default: break;
     }
     return 0;
 }
@@ -42,6 +42,7 @@ typedef struct frame {
 void                bit_data_to_bytes(u8 *data, int data_len, u8 *out);
 int                 build_pdu(u8 pdu[MB_MAX_PDU_LEN], u8 *data, func_cxt_t fdata);
 int                 build_adu(u8 *adu, frame_t *frame);
+u16                 crc16(u8 *data, u16 len);
 int                 mb_get_expected_adu_len(mb_protocol_t proto, u8 *adu, int adu_len, mb_dir_t dir);
 int                 client_get_expected_rsp_adu_len(mb_protocol_t protocol, func_cxt_t *fcxt);
 void                mb_extract_frame(mb_protocol_t proto, u8 *adu, int adu_len, frame_t *out);
@@ -49,6 +50,7 @@ mb_validation_err_t mb_is_adu_valid(mb_protocol_t proto, u8 *adu, int adu_len);
 int                 check_req_rsp_pdu(u8 *req, u8 req_len, u8 *rsp, u8 rsp_len);
 char                nibble_to_hex(u8 d);
 const char         *str_protocol(mb_protocol_t protocol);
+mb_protocol_t       mb_framing(mb_protocol_t protocol);
 void                str_curr_endpoint(char out[32], global_t *global);
 const char         *str_fc(fc_t fc);
 const char         *str_valid_err(mb_validation_err_t err);
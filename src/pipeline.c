@@ -0,0 +1,443 @@
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "helping_hand.h"
+#include "pipeline.h"
+#include "request.h"
+#include "tui.h"
+#include "uplink.h"
+
+#define PIPE_SLOT(pl, tid) (&(pl)->slots[(tid) & (PIPE_MAX_WINDOW - 1)])
+
+void
+pipe_init(pipeline_t *pl, client_cxt_t *cxt, statistic_t *stats, int window) {
+    memset(pl, 0, sizeof(*pl));
+
+    pl->cxt    = cxt;
+    pl->stats  = stats;
+    pl->fd     = cxt->fd;
+    pl->window = CLAMP(window, 1, PIPE_MAX_WINDOW);
+}
+
+// everything in flight is lost, count it as failed
+static void
+pipe_abort(pipeline_t *pl, const char *reason) {
+    if (pl->count) {
+        log_linef("! %d requests in flight dropped: %s", pl->count, reason);
+    }
+
+    for (int i = 0; i < PIPE_MAX_WINDOW; i++) {
+        if (pl->slots[i].used) {
+            pl->slots[i].used = FALSE;
+            STAT_INC(pl->stats, fails);
+        }
+    }
+
+    pl->count = 0;
+    rx_reset(&pl->rx);
+}
+
+void
+pipe_close(pipeline_t *pl, const char *reason) {
+    pipe_abort(pl, reason);
+
+    if (pl->cxt->fd >= 0) {
+        close(pl->cxt->fd);
+        pl->cxt->fd = -1;
+    }
+    pl->fd = -1;
+}
+
+// connection could be reopened under our feet (relink), old requests won't be answered on new one
+static void
+pipe_sync_fd(pipeline_t *pl) {
+    if (pl->fd != pl->cxt->fd) {
+        pipe_abort(pl, "connection changed");
+        pl->fd = pl->cxt->fd;
+    }
+}
+
+// rtu framing has no tid, every request takes slot 0, so only one can be in flight
+static u16
+pipe_next_tid(pipeline_t *pl) {
+    return mb_framing(pl->cxt->protocol) == MB_PROTOCOL_TCP ? pl->cxt->tid : 0;
+}
+
+int
+pipe_can_send(pipeline_t *pl) {
+    return pl->cxt->fd >= 0 && pl->count < pl->window && !PIPE_SLOT(pl, pipe_next_tid(pl))->used;
+}
+
+// -------------------- Send --------------------------------------------------------------
+
+static int
+pipe_write_all(pipeline_t *pl, u8 *adu, int adu_len, u64 deadline) {
+    int sent = 0;
+
+    while (sent < adu_len) {
+        int rc = write(pl->fd, adu + sent, adu_len - sent);
+        if (rc > 0) {
+            sent += rc;
+        } else if (rc < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // send buffer is full, slave reads slower than we write
+            if (uplink_wait_writable(pl->fd, deadline) != RC_SUCCESS) {
+                return RC_FAIL;
+            }
+        } else if (rc < 0 && errno == EINTR) {
+            continue;
+        } else {
+            return RC_ERROR;
+        }
+    }
+
+    return RC_SUCCESS;
+}
+
+// build next request into out and put it in flight, sending it is up to the caller
+// returns adu length or RC_FAIL
+int
+pipe_stage(pipeline_t *pl, u8 *out, int out_size) {
+    pipe_sync_fd(pl);
+    if (!pipe_can_send(pl)) {
+        return RC_FAIL;
+    }
+
+    // without tid, leftovers of timed out request can't be told from response to this one
+    if (mb_framing(pl->cxt->protocol) != MB_PROTOCOL_TCP) {
+        rx_reset(&pl->rx);
+    }
+
+    frame_t frame = {0};
+    init_request_frame(pl->cxt, &frame);
+
+    int adu_len = 0;
+    u8 *adu     = request_adu(pl->cxt, &frame, &adu_len);
+    if (!adu || adu_len > out_size) {
+        return RC_FAIL;
+    }
+    memcpy(out, adu, adu_len);
+
+    u64 now = now_us();
+
+    STAT_INC(pl->stats, requests);
+    STAT_ADD(pl->stats, bytes_out, adu_len);
+    log_adu_at(pl->name, adu, adu_len, frame.protocol, DS_OUT_OK);
+
+    inflight_t *slot  = PIPE_SLOT(pl, frame.tid);
+    slot->used        = TRUE;
+    slot->sent_us     = now;
+    slot->deadline_us = now + rto_timeout_us(&pl->cxt->rto[frame.uid], &pl->cxt->rto_link);
+    slot->intended_us = pl->intended_us ? MIN_VAL(pl->intended_us, now) : now;
+    slot->frame       = frame;
+    pl->count++;
+
+    return adu_len;
+}
+
+int
+pipe_send(pipeline_t *pl) {
+    u8  adu[MB_MAX_ADU_LEN] = {0};
+    int adu_len             = pipe_stage(pl, adu, sizeof(adu));
+    if (adu_len <= 0) {
+        return RC_FAIL;
+    }
+
+    u64 deadline = now_us() + (u64)globals.response_timeout * 1000;
+
+    // request is in flight already, so closing pipeline accounts it as failed
+    int rc = pipe_write_all(pl, adu, adu_len, deadline);
+    if (rc == RC_ERROR) {
+        log_linef("! bad fd: %s", strerror(errno));
+        pipe_close(pl, "failed to send");
+        return RC_FAIL;
+    } else if (rc == RC_FAIL) {
+        // we don't know how much of adu went through, stream is broken anyway
+        log_traffic_str_at(pl->name, "failed to send", DS_OUT_FAIL);
+        pipe_close(pl, "send stalled");
+        return RC_FAIL;
+    }
+
+    return RC_SUCCESS;
+}
+
+// -------------------- Receive -----------------------------------------------------------
+
+static void
+pipe_handle_adu(pipeline_t *pl, u8 *adu, int adu_len) {
+    mb_protocol_t proto = pl->cxt->protocol;
+    STAT_ADD(pl->stats, bytes_in, adu_len);
+
+    int verr = mb_is_adu_valid(proto, adu, adu_len);
+    if (verr != MB_VALIDATION_ERROR_OK) {
+        STAT_INC(pl->stats, fails);
+        log_traffic_str_at(pl->name, str_valid_err(verr), DS_IN_FAIL);
+        return;
+    }
+
+    frame_t rsp_frame = {0};
+    mb_extract_frame(proto, adu, adu_len, &rsp_frame);
+
+    // can be response that we already count as timed out
+    inflight_t *slot = PIPE_SLOT(pl, rsp_frame.tid);
+    if (!slot->used || slot->frame.tid != rsp_frame.tid) {
+        char msg[48] = {0};
+        snprintf(msg, sizeof(msg), "late response (tid: %d)", rsp_frame.tid);
+        log_traffic_str_at(pl->name, msg, DS_IN_FAIL);
+        STAT_INC(pl->stats, late_responses);
+        return;
+    }
+
+    frame_t *req_frame = &slot->frame;
+    u64      now       = now_us();
+    u32      rtt       = now - slot->sent_us;
+    rto_sample(&pl->cxt->rto[req_frame->uid], &pl->cxt->rto_link, rtt);
+    STAT_ADD(pl->stats, rsp_sum_us, rtt);
+    STAT_INC(pl->stats, rsp_count);
+    if (pl->latency) {
+        hist_record(pl->latency, rtt);
+        hist_record_co(pl->corrected, now - slot->intended_us, pl->backfill_us);
+    }
+
+    if (check_req_rsp_pdu(req_frame->pdu, req_frame->pdu_len, rsp_frame.pdu, rsp_frame.pdu_len)) {
+        log_adu_at(pl->name, adu, adu_len, proto, DS_IN_OK);
+        STAT_INC(pl->stats, success);
+    } else {
+        log_adu_at(pl->name, adu, adu_len, proto, DS_IN_FAIL);
+        STAT_INC(pl->stats, fails);
+        if (rsp_frame.pdu_len && rsp_frame.pdu[0] & 0x80) {
+            STAT_INC(pl->stats, exceptions);
+        }
+    }
+
+    slot->used = FALSE;
+    pl->count--;
+}
+
+// responses can be coalesced in one segment or split between few of them
+static void
+pipe_parse(pipeline_t *pl) {
+    u8  adu[MB_MAX_ADU_LEN];
+    int adu_len = 0;
+
+    while ((adu_len = rx_next_adu(&pl->rx, pl->cxt->protocol, MB_DIR_RESPONSE, adu)) != 0) {
+        if (adu_len < 0) {
+            log_traffic_str_at(pl->name, "garbage in stream", DS_IN_FAIL);
+            STAT_INC(pl->stats, fails);
+            continue;
+        }
+
+        pipe_handle_adu(pl, adu, adu_len);
+    }
+}
+
+// every datagram carries exactly one adu, nothing is carried over to the next one
+static void
+pipe_parse_dgram(pipeline_t *pl, const u8 *data, int len) {
+    u8 adu[MB_MAX_ADU_LEN];
+
+    if (len > MB_MAX_ADU_LEN) {
+        log_traffic_str_at(pl->name, "datagram is too long", DS_IN_FAIL);
+        STAT_INC(pl->stats, fails);
+        return;
+    }
+    memcpy(adu, data, len);
+
+    if (mb_get_expected_adu_len(pl->cxt->protocol, adu, len, MB_DIR_RESPONSE) != len) {
+        log_traffic_str_at(pl->name, "bad datagram", DS_IN_FAIL);
+        STAT_INC(pl->stats, fails);
+        return;
+    }
+
+    pipe_handle_adu(pl, adu, len);
+}
+
+// handle result of one read done by someone else: data, 0 on EOF or -errno
+int
+pipe_feed(pipeline_t *pl, const u8 *data, int len) {
+    int dgram = uplink_kind(pl->cxt->protocol) == UPLINK_DGRAM;
+
+    if (dgram && len == -ECONNREFUSED) {
+        // icmp port unreachable for one of earlier datagrams, socket itself is fine
+        log_traffic_str_at(pl->name, "port unreachable", DS_IN_FAIL);
+        return RC_SUCCESS;
+    } else if (dgram && len >= 0) {
+        pipe_parse_dgram(pl, data, len);
+        return RC_SUCCESS;
+    } else if (len == 0) {
+        log_traffic_str_at(pl->name, "connection closed by peer", DS_IN_FAIL);
+        pipe_close(pl, "connection closed");
+        return RC_FAIL;
+    } else if (len < 0) {
+        log_linef("! failed to read response: %s", strerror(-len));
+        pipe_close(pl, "failed to read");
+        return RC_FAIL;
+    }
+
+    while (len > 0) {
+        int add = rx_push(&pl->rx, data, len);
+
+        data += add;
+        len  -= add;
+
+        pipe_parse(pl);
+    }
+
+    return RC_SUCCESS;
+}
+
+// read whatever is available and handle every complete response in it, fd is nonblocking
+int
+pipe_recv(pipeline_t *pl) {
+    pipe_sync_fd(pl);
+    if (pl->fd < 0) {
+        return RC_FAIL;
+    }
+
+    if (uplink_kind(pl->cxt->protocol) == UPLINK_DGRAM) {
+        // MSG_TRUNC: length of the whole datagram, so oversized one is not taken as valid
+        u8  dgram[MB_MAX_ADU_LEN];
+        int add = recv(pl->fd, dgram, sizeof(dgram), MSG_TRUNC);
+        if (add < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+            return RC_SUCCESS;
+        }
+        return pipe_feed(pl, dgram, add < 0 ? -errno : add);
+    }
+
+    // read straight into the ring, one read can bring many responses
+    int room = 0;
+    u8 *dst  = rx_write_ptr(&pl->rx, &room);
+
+    int add = read(pl->fd, dst, room);
+    if (add < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+        return RC_SUCCESS;
+    } else if (add <= 0) {
+        return pipe_feed(pl, NULL, add < 0 ? -errno : 0);
+    }
+
+    rx_produce(&pl->rx, add);
+    pipe_parse(pl);
+
+    return RC_SUCCESS;
+}
+
+// -------------------- Timeouts ----------------------------------------------------------
+
+void
+pipe_expire(pipeline_t *pl, u64 now) {
+    if (!pl->count) {
+        return;
+    }
+
+    for (int i = 0; i < PIPE_MAX_WINDOW; i++) {
+        inflight_t *slot = &pl->slots[i];
+        if (!slot->used || slot->deadline_us > now) {
+            continue;
+        }
+
+        u32 overshoot = now - slot->deadline_us;
+
+        STAT_ADD(pl->stats, overshoot_sum_us, overshoot);
+        STAT_MAX(pl->stats, overshoot_max_us, overshoot);
+        STAT_INC(pl->stats, timeouts);
+        if (pl->latency) {
+            hist_record_co(pl->corrected, now - slot->intended_us, pl->backfill_us);
+        }
+
+        log_traffic_str_at(pl->name, "timed out", DS_IN_FAIL);
+        rto_expired(&pl->cxt->rto[slot->frame.uid]);
+
+        slot->used = FALSE;
+        pl->count--;
+    }
+}
+
+// the closest deadline among requests in flight, 0 if nothing is in flight
+u64
+pipe_next_deadline(pipeline_t *pl) {
+    u64 next = 0;
+
+    if (!pl->count) {
+        return next;
+    }
+
+    for (int i = 0; i < PIPE_MAX_WINDOW; i++) {
+        inflight_t *slot = &pl->slots[i];
+        if (slot->used && (!next || slot->deadline_us < next)) {
+            next = slot->deadline_us;
+        }
+    }
+
+    return next;
+}
+
+// -------------------- Base --------------------------------------------------------------
+
+// sleep until some response arrives, the closest request expires or until_us (0 - no limit), then handle it
+int
+pipe_wait_until(pipeline_t *pl, u64 until_us) {
+    pipe_sync_fd(pl);
+    if (!pl->count) {
+        return RC_SUCCESS;
+    }
+
+    u64 deadline = pipe_next_deadline(pl);
+    if (until_us && until_us < deadline) {
+        deadline = until_us;
+    }
+
+    int rc = uplink_wait_readable(pl->fd, deadline);
+    if (rc == RC_SUCCESS) {
+        if (!pipe_recv(pl)) {
+            return RC_FAIL;
+        }
+    } else if (rc == RC_ERROR) {
+        log_linef("! failed to wait for response: %s", strerror(errno));
+        return RC_FAIL;
+    }
+
+    pipe_expire(pl, now_us());
+    return RC_SUCCESS;
+}
+
+// sleep until some response arrives or the closest request expires, then handle it
+int
+pipe_wait(pipeline_t *pl) {
+    return pipe_wait_until(pl, 0);
+}
+
+// send one more request, if window is full wait until some of requests in flight are done
+int
+pipe_request(pipeline_t *pl) {
+    pipe_sync_fd(pl);
+    if (pl->fd < 0) {
+        return RC_FAIL;
+    }
+
+    // handle responses which arrived in the meantime
+    if (pl->count && !pipe_recv(pl)) {
+        return RC_FAIL;
+    }
+    pipe_expire(pl, now_us());
+
+    while (!pipe_can_send(pl)) {
+        if (pl->fd < 0 || !pipe_wait(pl)) {
+            return RC_FAIL;
+        }
+    }
+
+    return pipe_send(pl);
+}
+
+// wait for everything in flight to be answered or timed out
+void
+pipe_drain(pipeline_t *pl) {
+    while (pl->count) {
+        if (!pipe_wait(pl)) {
+            pipe_abort(pl, "connection lost");
+            return;
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "client_cxt.h"
+#include "mb_base.h"
+#include "rx_ring.h"
+
+#define PIPE_MAX_WINDOW 256 // power of 2, slot of request is its tid masked by it
+
+typedef struct inflight {
+    u8      used;
+    u64     sent_us;
+    u64     deadline_us;
+    u64     intended_us; // when it was due, latency corrected for coordinated omission counts from here
+    frame_t frame;
+} inflight_t;
+
+// Modbus requests kept in flight over one connection, matched to responses by tid (one at a time for rtu framing)
+typedef struct pipeline {
+    client_cxt_t *cxt;       // connection requests are sent over
+    statistic_t  *stats;     // where results are accounted
+    const char   *name;      // endpoint name for log, NULL - current endpoint
+    hist_t       *latency;   // response time histogram of thread pipeline runs in, NULL - not recorded
+    hist_t       *corrected; // and the same corrected for coordinated omission
+
+    u64 intended_us; // open loop: when request being sent was due, 0 - when it is sent
+    u64 backfill_us; // interval mode: stalls are back filled every so much in corrected histogram
+
+    int fd;     // fd in-flight requests were sent to
+    int window; // how much requests can be in flight at once
+    int count;  // how much requests are in flight right now
+
+    inflight_t slots[PIPE_MAX_WINDOW];
+
+    // bytes of responses that are not complete yet
+    rx_ring_t rx;
+} pipeline_t;
+
+void pipe_init(pipeline_t *pl, client_cxt_t *cxt, statistic_t *stats, int window);
+int  pipe_can_send(pipeline_t *pl);
+int  pipe_stage(pipeline_t *pl, u8 *out, int out_size);
+int  pipe_send(pipeline_t *pl);
+int  pipe_feed(pipeline_t *pl, const u8 *data, int len);
+int  pipe_recv(pipeline_t *pl);
+void pipe_close(pipeline_t *pl, const char *reason);
+void pipe_expire(pipeline_t *pl, u64 now);
+u64  pipe_next_deadline(pipeline_t *pl);
+int  pipe_wait(pipeline_t *pl);
+int  pipe_wait_until(pipeline_t *pl, u64 until_us);
+int  pipe_request(pipeline_t *pl);
+void pipe_drain(pipeline_t *pl);
+
+#endif
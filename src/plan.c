@@ -0,0 +1,514 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "helping_hand.h"
+#include "plan.h"
+
+// ======================================================================================
+// Load
+// ======================================================================================
+
+static int
+plan_int(const char *str, int min, int max, int *out) {
+    char *end = NULL;
+
+    errno  = 0;
+    long v = strtol(str, &end, 0);
+    if (errno || end == str || *end != '\0' || v < min || v > max) {
+        return RC_FAIL;
+    }
+
+    *out = v;
+    return RC_SUCCESS;
+}
+
+// how many items fc can read and write at most, 0 - fc doesn't take count
+static void
+plan_limits(fc_t fc, int *max_read, int *max_write) {
+    *max_read  = 0;
+    *max_write = 0;
+
+    switch (fc) {
+    case MB_FC_READ_COILS:
+    case MB_FC_READ_DISCRETE_INPUTS: *max_read = MB_MAX_READ_BITS; break;
+    case MB_FC_READ_HOLDING_REGISTERS:
+    case MB_FC_READ_INPUT_REGISTERS: *max_read = MB_MAX_READ_REGS; break;
+    case MB_FC_WRITE_MULTIPLE_COILS: *max_write = MB_MAX_WRITE_BITS; break;
+    case MB_FC_WRITE_MULTIPLE_REGISTERS: *max_write = MB_MAX_WRITE_REGS; break;
+    case MB_FC_WRITE_AND_READ_REGISTERS:
+        *max_read  = MB_MAX_WR_READ_REGS;
+        *max_write = MB_MAX_WR_WRITE_REGS;
+        break;
+    default: break;
+    }
+}
+
+// write data goes to build_pdu the way request.c lays it out: a byte per bit or u16 per register
+static void
+plan_put_wdata(u8 *wdata, int fflags, int i, int value) {
+    if (fflags & FCF_BITS) {
+        wdata[i] = value != 0;
+    } else {
+        ((u16 *)wdata)[i] = value;
+    }
+}
+
+// one line: key=value pairs, fc is the only required one
+// addr/count go to read or write side depending on fc, fc 23 takes raddr/rcount/waddr/wcount
+static const char *
+plan_parse_step(char *line, plan_step_t *step, int *weighted) {
+    u8   wdata[MB_MAX_WRITE_BITS * 2] = {0};
+    char data[2048]                   = {0};
+
+    // -1 - not given
+    int fc     = 0;
+    int uid    = 0;
+    int addr   = -1;
+    int count  = -1;
+    int raddr  = -1;
+    int rcount = -1;
+    int waddr  = -1;
+    int wcount = -1;
+    int repeat = 1;
+    int weight = 0;
+
+    for (char *tok = strtok(line, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char *val = strchr(tok, '=');
+        if (!val) {
+            return "expected key=value";
+        }
+        *val++ = '\0';
+
+        int ok = RC_SUCCESS;
+        if (strcmp(tok, "fc") == 0) {
+            ok = plan_int(val, 1, 0xFF, &fc);
+        } else if (strcmp(tok, "uid") == 0) {
+            ok = plan_int(val, 1, 255, &uid);
+        } else if (strcmp(tok, "addr") == 0) {
+            ok = plan_int(val, 0, 0xFFFF, &addr);
+        } else if (strcmp(tok, "count") == 0) {
+            ok = plan_int(val, 1, MB_MAX_READ_BITS, &count);
+        } else if (strcmp(tok, "raddr") == 0) {
+            ok = plan_int(val, 0, 0xFFFF, &raddr);
+        } else if (strcmp(tok, "rcount") == 0) {
+            ok = plan_int(val, 1, MB_MAX_READ_BITS, &rcount);
+        } else if (strcmp(tok, "waddr") == 0) {
+            ok = plan_int(val, 0, 0xFFFF, &waddr);
+        } else if (strcmp(tok, "wcount") == 0) {
+            ok = plan_int(val, 1, MB_MAX_WRITE_BITS, &wcount);
+        } else if (strcmp(tok, "repeat") == 0) {
+            ok = plan_int(val, 1, 0xFFFF, &repeat);
+        } else if (strcmp(tok, "weight") == 0) {
+            ok = plan_int(val, 1, 1000000, &weight);
+        } else if (strcmp(tok, "data") == 0) {
+            strncpy(data, val, sizeof(data) - 1);
+        } else {
+            return "unknown key";
+        }
+
+        if (!ok) {
+            return "invalid value";
+        }
+    }
+
+    int fflags = fc_flags(fc);
+    if (fflags < 0) {
+        return "missing or unsupported fc";
+    }
+
+    int max_read  = 0;
+    int max_write = 0;
+    plan_limits(fc, &max_read, &max_write);
+
+    // plain addr/count belong to the only side fc has
+    if (fflags & FCF_READ && !(fflags & FCF_WRITE)) {
+        raddr  = raddr < 0 ? addr : raddr;
+        rcount = rcount < 0 ? count : rcount;
+    } else if (fflags & FCF_WRITE && !(fflags & FCF_READ)) {
+        waddr  = waddr < 0 ? addr : waddr;
+        wcount = wcount < 0 ? count : wcount;
+    }
+
+    func_cxt_t fcxt = {.fc = fc};
+    if (fflags & FCF_READ) {
+        fcxt.raddress = MAX_VAL(raddr, 0);
+        fcxt.rcount   = rcount < 0 ? 1 : rcount;
+        if (fcxt.rcount > max_read) {
+            return "read count is too big for fc";
+        }
+    }
+    if (fflags & FCF_WRITE) {
+        fcxt.waddress = MAX_VAL(waddr, 0);
+        fcxt.wcount   = max_write ? (wcount < 0 ? 1 : wcount) : 1;
+        if (fcxt.wcount > max_write && max_write) {
+            return "write count is too big for fc";
+        }
+    }
+
+    // data: comma separated values, missing ones are 0, or random for every request
+    if (strcmp(data, "random") == 0) {
+        step->random = 1;
+    } else if (data[0]) {
+        int   n    = 0;
+        char *save = NULL;
+        for (char *v = strtok_r(data, ",", &save); v; v = strtok_r(NULL, ",", &save)) {
+            int value = 0;
+            if (n >= fcxt.wcount) {
+                return "more data than write count";
+            } else if (!plan_int(v, 0, 0xFFFF, &value)) {
+                return "invalid data value";
+            }
+            plan_put_wdata(wdata, fflags, n++, value);
+        }
+    }
+
+    int pdu_len = build_pdu(step->pdu, wdata, fcxt);
+    if (pdu_len <= 0) {
+        return "can't build pdu";
+    }
+
+    step->uid     = uid;
+    step->repeat  = repeat;
+    step->weight  = weight;
+    step->fcxt    = fcxt;
+    step->pdu_len = pdu_len;
+    *weighted    |= weight > 0;
+    return NULL;
+}
+
+// ======================================================================================
+// Coalesce
+// ======================================================================================
+
+#define WISH_SET(w, a) ((w)[(a) >> 3] |= 1 << ((a) & 7))
+#define WISH_GET(w, a) ((w)[(a) >> 3] & 1 << ((a) & 7))
+
+// list of addresses and ranges: 0-9,15,0x40-0x4F, duplicates and order don't matter
+static const char *
+plan_parse_wish(char *list, u8 *wish) {
+    char *save = NULL;
+    for (char *item = strtok_r(list, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        int   from = 0;
+        int   to   = 0;
+        char *dash = strchr(item, '-');
+        if (dash) {
+            *dash++ = '\0';
+        }
+
+        if (!plan_int(item, 0, 0xFFFF, &from) || (dash && !plan_int(dash, from, 0xFFFF, &to))) {
+            return "invalid address";
+        }
+        for (int a = from; a <= (dash ? to : from); a++) {
+            WISH_SET(wish, a);
+        }
+    }
+
+    return NULL;
+}
+
+// read line: read fc=1..4 [uid=N] [gap=N] addr=LIST
+// wanted items are covered by as few requests as fc limit allows, greedy from the lowest address:
+// request is stretched over up to gap unwanted items when the next wanted one is still in its reach
+static const char *
+plan_parse_read(char *line, plan_t *p) {
+    u8  wish[0x10000 / 8] = {0};
+    int fc                = 0;
+    int uid               = 0;
+    int gap               = 0;
+    int any               = 0;
+
+    strtok(line, " \t\r\n"); // "read"
+    for (char *tok = strtok(NULL, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char *val = strchr(tok, '=');
+        if (!val) {
+            return "expected key=value";
+        }
+        *val++ = '\0';
+
+        int ok = RC_SUCCESS;
+        if (strcmp(tok, "fc") == 0) {
+            ok = plan_int(val, 1, 0xFF, &fc);
+        } else if (strcmp(tok, "uid") == 0) {
+            ok = plan_int(val, 1, 255, &uid);
+        } else if (strcmp(tok, "gap") == 0) {
+            ok = plan_int(val, 0, PLAN_MAX_GAP, &gap);
+        } else if (strcmp(tok, "addr") == 0) {
+            // strtok is in the middle of the line, list is split with its own
+            const char *err = plan_parse_wish(val, wish);
+            if (err) {
+                return err;
+            }
+            any = 1;
+        } else {
+            return "unknown key";
+        }
+
+        if (!ok) {
+            return "invalid value";
+        }
+    }
+
+    int max = 0;
+    int unused;
+    plan_limits(fc, &max, &unused);
+    if (!max || fc_flags(fc) & FCF_WRITE) {
+        return "read line takes fc 1, 2, 3 or 4";
+    }
+    if (!any) {
+        return "read line needs addr";
+    }
+
+    int a = 0;
+    while (a <= 0xFFFF) {
+        if (!WISH_GET(wish, a)) {
+            a++;
+            continue;
+        }
+
+        // a is the first wanted item not covered yet, last is the last wanted one request reaches
+        int last = a;
+        for (int b = a + 1; b <= 0xFFFF && b - a < max && b - last - 1 <= gap; b++) {
+            if (WISH_GET(wish, b)) {
+                last = b;
+                p->wanted++;
+            }
+        }
+        p->wanted++;
+
+        if (p->len >= PLAN_MAX_STEPS) {
+            return "too many steps";
+        }
+
+        plan_step_t *step = &p->steps[p->len];
+        step->uid         = uid;
+        step->repeat      = 1;
+        step->fcxt        = (func_cxt_t){.fc = fc, .raddress = a, .rcount = last - a + 1};
+        step->pdu_len     = build_pdu(step->pdu, NULL, step->fcxt);
+        if (p->ngroups) {
+            p->groups[p->ngroups - 1].len++;
+        }
+        p->len++;
+        p->coalesced++;
+
+        a = last + 1;
+    }
+
+    return NULL;
+}
+
+// group line: group name=NAME period=MS, steps up to the next group line are its
+static const char *
+plan_parse_group(char *line, plan_t *p) {
+    if (p->ngroups >= PLAN_MAX_GROUPS) {
+        return "too many groups";
+    }
+
+    plan_group_t *g      = &p->groups[p->ngroups];
+    int           period = 0;
+
+    strtok(line, " \t\r\n"); // "group"
+    for (char *tok = strtok(NULL, " \t\r\n"); tok; tok = strtok(NULL, " \t\r\n")) {
+        char *val = strchr(tok, '=');
+        if (!val) {
+            return "expected key=value";
+        }
+        *val++ = '\0';
+
+        if (strcmp(tok, "name") == 0) {
+            snprintf(g->name, sizeof(g->name), "%s", val);
+        } else if (strcmp(tok, "period") == 0) {
+            if (!plan_int(val, 1, 3600000, &period)) {
+                return "invalid value";
+            }
+        } else {
+            return "unknown key";
+        }
+    }
+
+    if (!period) {
+        return "group needs period";
+    }
+    if (!g->name[0]) {
+        snprintf(g->name, sizeof(g->name), "#%d", p->ngroups + 1);
+    }
+
+    g->period_ns = (u64)period * 1000000;
+    g->first     = p->len;
+    p->ngroups++;
+    return NULL;
+}
+
+static void
+plan_free(plan_t *p) {
+    free(p->steps);
+    free(p->groups);
+    free(p);
+}
+
+// compile plan file into steps with ready pdus, errors go to stdout as plan is loaded before tui starts
+plan_t *
+plan_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        printf("'%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+
+    plan_t *p = calloc(1, sizeof(plan_t));
+    if (p) {
+        p->steps  = calloc(PLAN_MAX_STEPS, sizeof(plan_step_t));
+        p->groups = calloc(PLAN_MAX_GROUPS, sizeof(plan_group_t));
+    }
+    if (!p || !p->steps || !p->groups) {
+        printf("failed to allocate plan\n");
+        if (p) {
+            plan_free(p);
+        }
+        fclose(f);
+        return NULL;
+    }
+    snprintf(p->name, sizeof(p->name), "%s", path);
+
+    char line[16384] = {0};
+    int  line_no     = 0;
+    int  weighted   = 0;
+    while (fgets(line, sizeof(line), f)) {
+        line_no++;
+
+        char *comment = strchr(line, '#');
+        if (comment) {
+            *comment = '\0';
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+
+        const char *err = NULL;
+        if (strncmp(line + strspn(line, " \t"), "group", 5) == 0) {
+            err = plan_parse_group(line, p);
+        } else if (strncmp(line + strspn(line, " \t"), "read", 4) == 0) {
+            err = plan_parse_read(line, p);
+        } else if (p->len >= PLAN_MAX_STEPS) {
+            err = "too many steps";
+        } else if (!(err = plan_parse_step(line, &p->steps[p->len], &weighted))) {
+            if (p->ngroups && (p->steps[p->len].repeat != 1 || p->steps[p->len].weight)) {
+                err = "repeat and weight don't apply to scan group steps";
+            } else if (p->ngroups) {
+                p->groups[p->ngroups - 1].len++;
+            }
+            p->len++;
+        }
+
+        if (err) {
+            printf("%s:%d: %s\n", path, line_no, err);
+            fclose(f);
+            plan_free(p);
+            return NULL;
+        }
+    }
+    fclose(f);
+
+    const char *err = NULL;
+    if (!p->len) {
+        err = "plan has no steps";
+    } else if (p->ngroups && p->groups[0].first) {
+        err = "steps before the first group";
+    }
+    for (int i = 0; i < p->ngroups && !err; i++) {
+        if (!p->groups[i].len) {
+            err = "group has no steps";
+        }
+    }
+    if (err) {
+        printf("%s: %s\n", path, err);
+        plan_free(p);
+        return NULL;
+    }
+
+    // weighted plan: step without weight counts as 1, weights become cumulative for the pick
+    if (weighted) {
+        for (int i = 0; i < p->len; i++) {
+            p->total_weight += MAX_VAL(p->steps[i].weight, 1);
+            p->steps[i].weight = p->total_weight;
+        }
+    }
+
+    return p;
+}
+
+// ======================================================================================
+// Walk
+// ======================================================================================
+
+static u64
+plan_rand(plan_cursor_t *c) {
+    if (!c->rand) {
+        c->rand = (u64)(unsigned long)c ^ now_ns();
+    }
+
+    c->rand ^= c->rand >> 12;
+    c->rand ^= c->rand << 25;
+    c->rand ^= c->rand >> 27;
+    return c->rand * 0x2545F4914F6CDD1Dull;
+}
+
+// step whose cumulative weight is the first one above w
+static u32
+plan_pick(const plan_t *p, u32 w) {
+    u32 lo = 0;
+    u32 hi = p->len - 1;
+
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (p->steps[mid].weight > w) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+}
+
+// fill frame of the next request with the next step of plan: fc, pdu and uid if step has its own
+void
+plan_frame(const plan_t *p, plan_cursor_t *c, frame_t *frame) {
+    if (p->ngroups) {
+        // scan: group to poll is set by scan_step(), its steps go in order
+        c->step = c->next % p->len;
+        c->next = c->step + 1;
+        c->left = c->left ? c->left - 1 : 0;
+    } else if (!c->left) {
+        if (p->total_weight) {
+            c->step = plan_pick(p, plan_rand(c) % p->total_weight);
+        } else {
+            c->step = c->next % p->len;
+            c->next = c->step + 1;
+        }
+        c->left = p->steps[c->step].repeat - 1;
+    } else {
+        c->left--;
+    }
+
+    const plan_step_t *s = &p->steps[c->step];
+
+    frame->fc = s->fcxt.fc;
+    if (s->uid) {
+        frame->uid = s->uid;
+    }
+
+    if (!s->random) {
+        frame->pdu_len = s->pdu_len;
+        memcpy(frame->pdu, s->pdu, s->pdu_len);
+        return;
+    }
+
+    u8  wdata[MB_MAX_WRITE_BITS * 2] = {0};
+    int fflags                       = fc_flags(s->fcxt.fc);
+    for (int i = 0; i < s->fcxt.wcount; i++) {
+        plan_put_wdata(wdata, fflags, i, fflags & FCF_BITS ? rand() % 2 : rand() % 0xFFFF);
+    }
+    frame->pdu_len = build_pdu(frame->pdu, wdata, s->fcxt);
+}
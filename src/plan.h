@@ -0,0 +1,49 @@
+#ifndef PLAN_H
+#define PLAN_H
+
+#include "client_cxt.h"
+#include "mb_base.h"
+
+#define PLAN_MAX_STEPS  4096
+#define PLAN_MAX_GROUPS 256
+#define PLAN_MAX_GAP    2000 // read line: most unwanted items one request may read to cover two wanted ones
+
+// one request of plan, pdu is built at load so sending it is only framing
+typedef struct plan_step {
+    u8  uid;    // 0 - unit id from settings
+    u8  random; // write data is random, pdu is rebuilt for every request
+    u16 repeat; // step is sent that many times in a row
+    u32 weight; // weighted plan: sum of weights of steps up to this one
+
+    func_cxt_t fcxt;
+    u8         pdu_len;
+    u8         pdu[MB_MAX_PDU_LEN];
+} plan_step_t;
+
+// scan group: steps first..first+len-1 are polled one after another every period
+typedef struct plan_group {
+    char name[16];
+    u64  period_ns;
+    u32  first;
+    u32  len;
+} plan_group_t;
+
+// --plan: requests sent in place of the single one from settings
+typedef struct plan {
+    char         name[64]; // file plan was loaded from
+    plan_step_t *steps;
+    int          len;
+    u32          total_weight; // 0 - steps go in file order
+
+    plan_group_t *groups; // scan table: steps are polled by groups, each on its own period
+    int           ngroups;
+
+    // read lines: items wanted and steps they were coalesced into
+    u32 wanted;
+    u32 coalesced;
+} plan_t;
+
+plan_t *plan_load(const char *path);
+void    plan_frame(const plan_t *p, plan_cursor_t *c, frame_t *frame);
+
+#endif
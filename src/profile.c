@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "profile.h"
+#include "tui.h"
+
+// ======================================================================================
+// Parse
+// ======================================================================================
+
+static int
+profile_add(profile_t *p, phase_kind_t kind, int from, int to, int secs) {
+    if (p->len >= PROFILE_MAX_PHASES) {
+        printf("profile has more than %d phases\n", PROFILE_MAX_PHASES);
+        return RC_FAIL;
+    }
+    if (secs < 1) {
+        // negative one would turn into a duration of centuries
+        printf("profile phase duration must be at least 1 s, got %d\n", secs);
+        return RC_FAIL;
+    }
+
+    p->phases[p->len++] = (phase_t){.kind = kind, .from = from, .to = to, .dur_ns = (u64)secs * 1000000000};
+    return RC_SUCCESS;
+}
+
+static int
+profile_valid_rate(int rate) {
+    return rate >= 1 && rate <= 10000000;
+}
+
+// one phase of spec, step expands to one phase per step
+static int
+profile_parse_phase(profile_t *p, const char *item) {
+    int from  = 0;
+    int to    = 0;
+    int inc   = 0;
+    int steps = 0;
+    int secs  = 0;
+    int n     = 0;
+
+    if (sscanf(item, "ramp:%d-%d:%d%n", &from, &to, &secs, &n) == 3 && !item[n]) {
+        if (!profile_valid_rate(from) || !profile_valid_rate(to)) {
+            return RC_FAIL;
+        }
+        return profile_add(p, PHASE_RAMP, from, to, secs);
+    } else if (sscanf(item, "hold:%d:%d%n", &from, &secs, &n) == 2 && !item[n]) {
+        return profile_valid_rate(from) && profile_add(p, PHASE_HOLD, from, from, secs);
+    } else if (sscanf(item, "spike:%d:%d%n", &from, &secs, &n) == 2 && !item[n]) {
+        return profile_valid_rate(from) && profile_add(p, PHASE_SPIKE, from, from, secs);
+    } else if (sscanf(item, "step:%d+%dx%d:%d%n", &from, &inc, &steps, &secs, &n) == 4 && !item[n]) {
+        if (steps < 1) {
+            printf("profile step count must be at least 1, got %d\n", steps);
+            return RC_FAIL;
+        }
+        for (int i = 0; i < steps; i++) {
+            int rate = from + inc * i;
+            if (!profile_valid_rate(rate) || !profile_add(p, PHASE_STEP, rate, rate, secs)) {
+                return RC_FAIL;
+            }
+        }
+        return RC_SUCCESS;
+    }
+
+    return RC_FAIL;
+}
+
+// spec: comma separated phases, rates in req/s and durations in seconds
+//  ramp:FROM-TO:SECS, hold:RATE:SECS, spike:RATE:SECS, step:FROM+INCxCOUNT:SECS
+profile_t *
+profile_parse(const char *spec) {
+    profile_t *p = aligned_alloc(STATS_LINE, sizeof(profile_t));
+    if (!p) {
+        printf("failed to allocate profile\n");
+        return NULL;
+    }
+    memset(p, 0, sizeof(profile_t));
+
+    char  buf[1024] = {0};
+    char *save      = NULL;
+    snprintf(buf, sizeof(buf), "%s", spec);
+    for (char *item = strtok_r(buf, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        if (!profile_parse_phase(p, item)) {
+            printf("invalid profile phase: '%s'\n", item);
+            free(p);
+            return NULL;
+        }
+    }
+
+    if (!p->len) {
+        printf("profile has no phases\n");
+        free(p);
+        return NULL;
+    }
+
+    return p;
+}
+
+// ======================================================================================
+// Run
+// ======================================================================================
+
+// target rate elapsed_ns into the run, phase is set to len once the last phase is over
+int
+profile_rate(const profile_t *p, u64 elapsed_ns, int *phase) {
+    for (int i = 0; i < p->len; i++) {
+        const phase_t *ph = &p->phases[i];
+        if (elapsed_ns >= ph->dur_ns) {
+            elapsed_ns -= ph->dur_ns;
+            continue;
+        }
+
+        *phase = i;
+        return ph->from + (int)((double)(ph->to - ph->from) * elapsed_ns / ph->dur_ns);
+    }
+
+    *phase = p->len;
+    return p->phases[p->len - 1].to;
+}
+
+// take totals at the end of phase, -1 - at the start of run
+void
+profile_close(profile_t *p, int phase, u64 elapsed_ns, const statistic_t *stats, const sched_t *sched) {
+    phase_t *ph = phase < 0 ? &p->start : &p->phases[phase];
+
+    ph->stats     = *stats;
+    ph->epoch     = __atomic_load_n(&stats_epoch, __ATOMIC_RELAXED);
+    ph->issued    = sched->issued;
+    ph->late      = sched->late;
+    ph->closed_ns = elapsed_ns;
+    p->done       = phase + 1;
+}
+
+static const char *
+str_phase(const phase_t *ph, char *out, int size) {
+    switch (ph->kind) {
+    case PHASE_RAMP: snprintf(out, size, "ramp %d-%d req/s", ph->from, ph->to); break;
+    case PHASE_HOLD: snprintf(out, size, "hold %d req/s", ph->from); break;
+    case PHASE_STEP: snprintf(out, size, "step %d req/s", ph->from); break;
+    case PHASE_SPIKE: snprintf(out, size, "spike %d req/s", ph->from); break;
+    }
+    return out;
+}
+
+// summary of every phase closed in this run
+void
+profile_log(const profile_t *p) {
+    for (int i = 0; i < p->done; i++) {
+        const phase_t *ph   = &p->phases[i];
+        const phase_t *prev = i ? &p->phases[i - 1] : &p->start;
+
+        // statistic was reset during phase, it counts from the reset
+        static const statistic_t zero  = {0};
+        int                      reset = ph->epoch != prev->epoch;
+        const statistic_t       *base  = reset ? &zero : &prev->stats;
+
+        char name[48] = {0};
+        u64  dur      = MAX_VAL(ph->closed_ns - prev->closed_ns, 1);
+        u64  reqs     = ph->stats.requests - base->requests;
+        u64  ok       = ph->stats.success - base->success;
+        u64  rsps     = ph->stats.rsp_count - base->rsp_count;
+        u64  rsp_sum  = ph->stats.rsp_sum_us - base->rsp_sum_us;
+
+        log_linef("  phase %d %-20s %5.1f s: %.1f req/s, %lu requests, %.2f%% ok, %lu timeouts, %lu fails, %lu late, "
+                  "response avg %lu us%s",
+          i + 1, str_phase(ph, name, sizeof(name)), dur / 1e9, (ph->issued - prev->issued) * 1e9 / dur,
+          reqs, (double)ok / MAX_VAL(reqs, 1) * 100, ph->stats.timeouts - base->timeouts,
+          ph->stats.fails - base->fails, ph->late - prev->late, rsp_sum / MAX_VAL(rsps, 1),
+          reset ? " (since statistic reset)" : "");
+    }
+}
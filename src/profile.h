@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "client_cxt.h"
+
+#define PROFILE_MAX_PHASES 64
+
+typedef enum phase_kind {
+    PHASE_HOLD,  // from req/s all the time
+    PHASE_RAMP,  // from -> to req/s linearly
+    PHASE_STEP,  // one step of step:, holds its rate
+    PHASE_SPIKE, // short hold way above the rest
+} phase_kind_t;
+
+typedef struct phase {
+    phase_kind_t kind;
+    int          from; // req/s
+    int          to;
+    u64          dur_ns;
+
+    // totals at the end of phase over all connections, summary is the difference to previous phase
+    statistic_t stats;
+    u32         epoch; // statistic reset stats belong to, see stats_reset()
+    u64         issued;
+    u64         late;
+    u64         closed_ns; // time into the run phase was closed at, run can be stopped before its end
+} phase_t;
+
+// --profile: open loop rate changing over the run, results are kept per phase
+typedef struct profile {
+    phase_t phases[PROFILE_MAX_PHASES];
+    int     len;
+
+    phase_t start; // totals when run started
+    int     done;  // phases closed in this run
+} profile_t;
+
+profile_t *profile_parse(const char *spec);
+int        profile_rate(const profile_t *p, u64 elapsed_ns, int *phase);
+void       profile_close(profile_t *p, int phase, u64 elapsed_ns, const statistic_t *stats, const sched_t *sched);
+void       profile_log(const profile_t *p);
+
+#endif
@@ -0,0 +1,220 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "helping_hand.h"
+#include "plan.h"
+#include "request.h"
+
+// -------------------- Write data --------------------------------------------------------
+
+static void
+build_wdata_bits(client_cxt_t *cxt, func_cxt_t *fcxt, u8 data[MB_MAX_WRITE_BITS]) {
+    int to_write = CLAMP(cxt->wcount, 0, MB_MAX_WRITE_BITS);
+    fcxt->wcount = to_write;
+
+    if (globals.random) {
+        for (int i = 0; i < to_write; i++) {
+            data[i] = rand() % 2;
+        }
+    } else {
+        to_write = CLAMP(to_write, 0, WD_MAX_LEN);
+        for (int i = 0; i < to_write; i++) {
+            // write what we have, everything else will be 0
+            data[i] = cxt->wdata[i];
+        }
+    }
+}
+
+static void
+build_wdata_regs(client_cxt_t *cxt, func_cxt_t *fcxt, u8 data[MB_MAX_WRITE_BITS]) {
+    int  fflags    = fc_flags(fcxt->fc);
+    int  max_write = fflags & FCF_READ ? MB_MAX_WR_WRITE_REGS : MB_MAX_WRITE_REGS;
+    u16 *write     = (void *)data;
+
+    int to_write = CLAMP(cxt->wcount, 0, max_write);
+    fcxt->wcount = to_write;
+
+    if (globals.random) {
+        for (int i = 0; i < to_write; i++) {
+            write[i] = rand() % 0xFFFF;
+        }
+    } else {
+        for (int i = 0; i < to_write; i++) {
+            // write what we have, everything else will be 0
+            write[i] = cxt->wdata[i];
+        }
+    }
+}
+
+// -------------------- Frame -------------------------------------------------------------
+
+// fill frame header for the next request: protocol, fc, next uid in sequence and next tid
+void
+init_request_frame(client_cxt_t *cxt, frame_t *frame) {
+    u16 tid = 0;
+    if (mb_framing(cxt->protocol) == MB_PROTOCOL_TCP) {
+        tid = cxt->tid++;
+    }
+
+    u8 uid = 1;
+    if (globals.sequence_uid) {
+        uid = cxt->current_uid;
+        PIND_CLAMP(cxt->current_uid, globals.slave_id_start, globals.slave_id_end);
+    } else {
+        uid = globals.slave_id_start;
+    }
+
+    frame->protocol = cxt->protocol;
+    frame->fc       = cxt->fc;
+    frame->uid      = uid;
+    frame->tid      = tid;
+
+    if (globals.plan) {
+        plan_frame(globals.plan, &cxt->plan, frame);
+    }
+}
+
+// build pdu into frame and whole adu into adu buffer, returns adu len or RC_FAIL
+static int
+build_request_adu(client_cxt_t *cxt, frame_t *frame, u8 adu[MB_MAX_ADU_LEN]) {
+    func_cxt_t fcxt = {
+      .fc = cxt->fc,
+    };
+    // can't write anything more than that anyway
+    u8 wdata[MB_MAX_WRITE_BITS] = {0};
+
+    // build data for request
+    int fflag = fc_flags(fcxt.fc);
+    if (fflag & FCF_READ) {
+        fcxt.raddress = cxt->raddress;
+        fcxt.rcount   = cxt->rcount;
+    }
+    if (fflag & FCF_WRITE) {
+        fcxt.waddress = cxt->waddress;
+        if (fflag & FCF_BITS) {
+            build_wdata_bits(cxt, &fcxt, wdata);
+        } else {
+            build_wdata_regs(cxt, &fcxt, wdata);
+        }
+    }
+
+    // build pdu
+    int pdu_len = build_pdu(frame->pdu, wdata, fcxt);
+    if (pdu_len > 0) {
+        frame->pdu_len = pdu_len;
+    } else {
+        return RC_FAIL;
+    }
+
+    // build adu
+    int adu_len = build_adu(adu, frame);
+    if (adu_len <= 0) {
+        return RC_FAIL;
+    }
+
+    return adu_len;
+}
+
+// -------------------- Template ----------------------------------------------------------
+
+// settings requests are built from were changed, every compiled template is stale now
+void
+request_invalidate(void) {
+    __atomic_add_fetch(&globals.cfg_gen, 1, __ATOMIC_RELEASE);
+}
+
+// random data is new for every request, such template can't be reused
+static int
+template_fresh(client_cxt_t *cxt) {
+    req_template_t *t = &cxt->tmpl;
+
+    if (globals.random && (fc_flags(cxt->fc) & FCF_WRITE)) {
+        return 0;
+    }
+
+    return t->adu_len > 0 && t->gen == __atomic_load_n(&globals.cfg_gen, __ATOMIC_ACQUIRE) &&
+           t->protocol == cxt->protocol && t->fc == cxt->fc;
+}
+
+static int
+template_compile(client_cxt_t *cxt, frame_t *frame) {
+    req_template_t *t = &cxt->tmpl;
+
+    t->adu_len = 0;
+    t->gen     = __atomic_load_n(&globals.cfg_gen, __ATOMIC_ACQUIRE);
+
+    int adu_len = build_request_adu(cxt, frame, t->adu);
+    if (adu_len <= 0) {
+        return RC_FAIL;
+    }
+
+    t->protocol = frame->protocol;
+    t->fc       = frame->fc;
+    t->uid      = frame->uid;
+    t->pdu_len  = frame->pdu_len;
+    memcpy(t->pdu, frame->pdu, frame->pdu_len);
+    t->adu_len = adu_len;
+    return RC_SUCCESS;
+}
+
+// only uid and tid differ between requests of the same settings, checksum is redone only if uid did change
+static int
+template_patch(client_cxt_t *cxt, frame_t *frame) {
+    req_template_t *t = &cxt->tmpl;
+
+    frame->pdu_len = t->pdu_len;
+    memcpy(frame->pdu, t->pdu, t->pdu_len);
+
+    switch (mb_framing(t->protocol)) {
+    case MB_PROTOCOL_TCP:
+        t->adu[0] = frame->tid >> 8;
+        t->adu[1] = frame->tid >> 0;
+        t->adu[6] = frame->uid;
+        break;
+
+    case MB_PROTOCOL_RTU:
+        if (t->uid != frame->uid) {
+            t->adu[0] = frame->uid;
+
+            u16 crc                = crc16(t->adu, t->adu_len - 2);
+            t->adu[t->adu_len - 2] = LO_NIBBLE(crc);
+            t->adu[t->adu_len - 1] = HI_NIBBLE(crc);
+        }
+        break;
+
+    case MB_PROTOCOL_ASCII:
+        // uid and lrc are hex encoded, not worth patching by hand
+        if (t->uid != frame->uid && build_adu(t->adu, frame) != t->adu_len) {
+            return RC_FAIL;
+        }
+        break;
+
+    default: return RC_FAIL;
+    }
+
+    t->uid = frame->uid;
+    return RC_SUCCESS;
+}
+
+// adu of the next request: compiled into template of cxt once and patched in place for the following ones
+// returned adu lives in cxt and is valid until the next call, returns NULL on fail
+u8 *
+request_adu(client_cxt_t *cxt, frame_t *frame, int *adu_len) {
+    // plan step comes with its pdu, only framing is left, template buffer is borrowed for it
+    if (globals.plan) {
+        cxt->tmpl.adu_len = 0;
+        *adu_len          = build_adu(cxt->tmpl.adu, frame);
+        return *adu_len > 0 ? cxt->tmpl.adu : NULL;
+    }
+
+    if (template_fresh(cxt)) {
+        if (!template_patch(cxt, frame)) {
+            return NULL;
+        }
+    } else if (!template_compile(cxt, frame)) {
+        return NULL;
+    }
+
+    *adu_len = cxt->tmpl.adu_len;
+    return cxt->tmpl.adu;
+}
@@ -0,0 +1,11 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+#include "client_cxt.h"
+#include "mb_base.h"
+
+void      init_request_frame(client_cxt_t *cxt, frame_t *frame);
+u8       *request_adu(client_cxt_t *cxt, frame_t *frame, int *adu_len);
+void      request_invalidate(void);
+
+#endif
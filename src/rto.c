@@ -0,0 +1,68 @@
+#include <stdlib.h>
+
+#include "client_cxt.h"
+#include "rto.h"
+
+// ceiling is --response_timeout, slave which doesn't answer costs no more than before
+static u32
+rto_ceil(void) {
+    return (u32)globals.response_timeout * 1000;
+}
+
+static u32
+rto_clamp(u32 us) {
+    u32 floor = (u32)globals.rto_min * 1000;
+    return CLAMP(us, MIN_VAL(floor, rto_ceil()), rto_ceil());
+}
+
+static void
+rto_update(rto_t *r, u32 rtt_us) {
+    if (!r->samples) {
+        r->srtt_us   = rtt_us;
+        r->rttvar_us = rtt_us / 2;
+    } else {
+        // rttvar = 3/4 rttvar + 1/4 |srtt - rtt|, srtt = 7/8 srtt + 1/8 rtt
+        u32 dev      = abs((int)r->srtt_us - (int)rtt_us);
+        r->rttvar_us = r->rttvar_us - r->rttvar_us / 4 + dev / 4;
+        r->srtt_us   = r->srtt_us - r->srtt_us / 8 + rtt_us / 8;
+    }
+
+    r->samples++;
+    r->rto_us = rto_clamp(r->srtt_us + MAX_VAL(RTO_GRANULARITY_US, 4 * r->rttvar_us));
+}
+
+// how long to wait for response of the slave, link is estimate over all slaves of connection
+u32
+rto_timeout_us(const rto_t *r, const rto_t *link) {
+    if (!globals.adaptive_timeout) {
+        return rto_ceil();
+    } else if (r->samples) {
+        return r->rto_us;
+    }
+
+    // slave is silent: as long as others usually take, full wait now and then in case it is just slow
+    if (!link->samples || r->misses % RTO_PROBE_EVERY == 0) {
+        return rto_ceil();
+    }
+    return link->rto_us;
+}
+
+// response came in rtt_us after request was sent
+void
+rto_sample(rto_t *r, rto_t *link, u32 rtt_us) {
+    rto_update(r, rtt_us);
+    rto_update(link, rtt_us);
+    r->misses = 0;
+}
+
+// no response in time: back off like tcp does, slave which doesn't answer even at ceiling is taken as silent
+void
+rto_expired(rto_t *r) {
+    r->misses++;
+
+    if (r->samples && r->rto_us >= rto_ceil()) {
+        r->samples = 0;
+    } else if (r->samples) {
+        r->rto_us = rto_clamp(r->rto_us * 2);
+    }
+}
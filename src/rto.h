@@ -0,0 +1,22 @@
+#ifndef RTO_H
+#define RTO_H
+
+#include "types.h"
+
+#define RTO_GRANULARITY_US 1000 // timer resolution the deadline must stay above, whatever variance is
+#define RTO_PROBE_EVERY    8    // slave which doesn't answer gets full --response_timeout once in that many requests
+
+// response time estimator of one slave, the way tcp estimates its retransmission timeout (RFC 6298)
+typedef struct rto {
+    u32 srtt_us;   // smoothed response time
+    u32 rttvar_us; // its mean deviation
+    u32 rto_us;    // response timeout, doubled by every timeout in a row
+    u32 samples;   // 0 - slave didn't answer yet or stopped answering
+    u32 misses;    // timeouts in a row
+} rto_t;
+
+u32  rto_timeout_us(const rto_t *r, const rto_t *link);
+void rto_sample(rto_t *r, rto_t *link, u32 rtt_us);
+void rto_expired(rto_t *r);
+
+#endif
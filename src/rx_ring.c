@@ -0,0 +1,110 @@
+#include <string.h>
+
+#include "rx_ring.h"
+
+#define RX_MASK (RX_RING_LEN - 1)
+
+void
+rx_reset(rx_ring_t *rx) {
+    rx->head = rx->tail = 0;
+}
+
+int
+rx_used(rx_ring_t *rx) {
+    return rx->tail - rx->head;
+}
+
+// contiguous free space to read() into, commit what was read with rx_produce()
+u8 *
+rx_write_ptr(rx_ring_t *rx, int *room) {
+    int free  = RX_RING_LEN - rx_used(rx);
+    int chunk = RX_RING_LEN - (rx->tail & RX_MASK);
+
+    *room = MIN_VAL(free, chunk);
+    return &rx->buf[rx->tail & RX_MASK];
+}
+
+void
+rx_produce(rx_ring_t *rx, int len) {
+    rx->tail += len;
+}
+
+// copy data received elsewhere (io_uring buffer), returns how much fit
+int
+rx_push(rx_ring_t *rx, const u8 *data, int len) {
+    int pushed = 0;
+
+    while (pushed < len) {
+        int room = 0;
+        u8 *dst  = rx_write_ptr(rx, &room);
+        if (!room) {
+            break;
+        }
+
+        int add = MIN_VAL(room, len - pushed);
+        memcpy(dst, data + pushed, add);
+        rx_produce(rx, add);
+        pushed += add;
+    }
+
+    return pushed;
+}
+
+// copy up to len bytes from head without consuming them, handles wrap around
+static int
+rx_peek(rx_ring_t *rx, u8 *out, int len) {
+    len = MIN_VAL(len, rx_used(rx));
+
+    int first = MIN_VAL(len, RX_RING_LEN - (int)(rx->head & RX_MASK));
+    memcpy(out, &rx->buf[rx->head & RX_MASK], first);
+    memcpy(out + first, rx->buf, len - first);
+
+    return len;
+}
+
+// skip bytes which can't be a start of adu
+static void
+rx_resync(rx_ring_t *rx, mb_protocol_t proto) {
+    switch (mb_framing(proto)) {
+    case MB_PROTOCOL_TCP:
+        // no way to find where next adu starts in a stream
+        rx->head = rx->tail;
+        break;
+
+    case MB_PROTOCOL_ASCII:
+        // next adu starts with ':'
+        rx->head++;
+        while (rx->head != rx->tail && rx->buf[rx->head & RX_MASK] != ':') {
+            rx->head++;
+        }
+        break;
+
+    default: rx->head++; break;
+    }
+}
+
+// take next complete adu out of the ring, bytes after it stay for the next call
+// returns adu length, 0 if adu is not complete yet or -1 if garbage was dropped
+int
+rx_next_adu(rx_ring_t *rx, mb_protocol_t proto, mb_dir_t dir, u8 out[MB_MAX_ADU_LEN]) {
+    if (!rx_used(rx)) {
+        return 0;
+    }
+
+    int have     = rx_peek(rx, out, MB_MAX_ADU_LEN);
+    int expected = mb_get_expected_adu_len(proto, out, have, dir);
+    if (expected < 0) {
+        rx_resync(rx, proto);
+        return -1;
+    } else if (expected == 0 || expected > have) {
+        // ring can't get any fuller than max adu without giving a frame
+        if (have == MB_MAX_ADU_LEN) {
+            rx_resync(rx, proto);
+            return -1;
+        }
+        return 0;
+    }
+
+    rx->head += expected;
+    return expected;
+}
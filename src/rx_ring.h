@@ -0,0 +1,23 @@
+#ifndef RX_RING_H
+#define RX_RING_H
+
+#include "mb_base.h"
+#include "types.h"
+
+#define RX_RING_LEN 4096 // power of 2, holds several max size ADUs of any protocol
+
+// bytes received over one connection and not framed yet, head and tail run freely
+typedef struct rx_ring {
+    u8  buf[RX_RING_LEN];
+    u32 head; // next byte to frame
+    u32 tail; // next byte to write
+} rx_ring_t;
+
+void rx_reset(rx_ring_t *rx);
+int  rx_used(rx_ring_t *rx);
+u8  *rx_write_ptr(rx_ring_t *rx, int *room);
+void rx_produce(rx_ring_t *rx, int len);
+int  rx_push(rx_ring_t *rx, const u8 *data, int len);
+int  rx_next_adu(rx_ring_t *rx, mb_protocol_t proto, mb_dir_t dir, u8 out[MB_MAX_ADU_LEN]);
+
+#endif
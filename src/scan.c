@@ -0,0 +1,140 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "scan.h"
+#include "tui.h"
+
+// ======================================================================================
+// Heap
+// ======================================================================================
+
+#define SCAN_NEXT(s, i) ((s)->groups[(s)->heap[i]].next_ns)
+
+static void
+scan_swap(scan_t *s, int a, int b) {
+    u16 tmp    = s->heap[a];
+    s->heap[a] = s->heap[b];
+    s->heap[b] = tmp;
+}
+
+// only the top ever changes its deadline, and only moves it later
+static void
+scan_sift_down(scan_t *s, int i) {
+    int len = s->plan->ngroups;
+
+    while (1) {
+        int min   = i;
+        int left  = 2 * i + 1;
+        int right = 2 * i + 2;
+
+        if (left < len && SCAN_NEXT(s, left) < SCAN_NEXT(s, min)) {
+            min = left;
+        }
+        if (right < len && SCAN_NEXT(s, right) < SCAN_NEXT(s, min)) {
+            min = right;
+        }
+        if (min == i) {
+            return;
+        }
+
+        scan_swap(s, i, min);
+        i = min;
+    }
+}
+
+// ======================================================================================
+// Base
+// ======================================================================================
+
+int
+scan_init(scan_t *s, const plan_t *plan, statistic_t *stats) {
+    s->plan   = plan;
+    s->stats  = stats;
+    s->groups = calloc(plan->ngroups, sizeof(scan_stat_t));
+    s->heap   = calloc(plan->ngroups, sizeof(u16));
+    if (!s->groups || !s->heap) {
+        free(s->groups);
+        free(s->heap);
+        s->groups = NULL;
+        s->heap   = NULL;
+        return RC_FAIL;
+    }
+
+    return RC_SUCCESS;
+}
+
+// every group is due right away, heap of equal deadlines is ordered already
+void
+scan_start(scan_t *s, u64 now) {
+    for (int i = 0; i < s->plan->ngroups; i++) {
+        s->groups[i] = (scan_stat_t){.next_ns = now};
+        s->heap[i]   = i;
+    }
+}
+
+// start polling the most urgent group if it is due and previous one is sent whole
+// returns FALSE if there is nothing to send yet
+int
+scan_step(scan_t *s, plan_cursor_t *c, u64 now) {
+    if (c->left) {
+        return TRUE;
+    }
+
+    u16                 g     = s->heap[0];
+    scan_stat_t        *st    = &s->groups[g];
+    const plan_group_t *group = &s->plan->groups[g];
+    if (now < st->next_ns) {
+        return FALSE;
+    }
+
+    // cycles whose time has passed completely are not polled at all, only counted
+    while (now >= st->next_ns + group->period_ns) {
+        st->next_ns += group->period_ns;
+        st->missed++;
+        STAT_INC(s->stats, scan_missed);
+    }
+
+    u64 jitter         = now - st->next_ns;
+    st->jitter_sum_ns += jitter;
+    st->jitter_max_ns  = MAX_VAL(st->jitter_max_ns, jitter);
+    st->next_ns       += group->period_ns;
+    st->cycles++;
+    scan_sift_down(s, 0);
+
+    c->next = group->first;
+    c->left = group->len;
+    return TRUE;
+}
+
+// when runner has to send next: right away while a group is being polled, otherwise at the closest deadline
+u64
+scan_next_ns(scan_t *s, plan_cursor_t *c) {
+    return c->left ? 0 : SCAN_NEXT(s, 0);
+}
+
+// sum group statistic of runner into out, one item per group
+void
+scan_add(scan_stat_t *out, const scan_t *s) {
+    if (!s->groups) {
+        return;
+    }
+
+    for (int i = 0; i < s->plan->ngroups; i++) {
+        out[i].cycles        += s->groups[i].cycles;
+        out[i].missed        += s->groups[i].missed;
+        out[i].jitter_sum_ns += s->groups[i].jitter_sum_ns;
+        out[i].jitter_max_ns  = MAX_VAL(out[i].jitter_max_ns, s->groups[i].jitter_max_ns);
+    }
+}
+
+void
+scan_log(const plan_t *plan, const scan_stat_t *stats) {
+    for (int i = 0; i < plan->ngroups; i++) {
+        const plan_group_t *g  = &plan->groups[i];
+        const scan_stat_t  *st = &stats[i];
+
+        log_linef("  group %-12s every %lu ms: %u cycles, %u missed, jitter avg %lu us, max %lu us", g->name,
+          g->period_ns / 1000000, st->cycles, st->missed, st->jitter_sum_ns / MAX_VAL(st->cycles, 1) / 1000,
+          st->jitter_max_ns / 1000);
+    }
+}
@@ -0,0 +1,32 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "client_cxt.h"
+#include "plan.h"
+
+// scan group of one runner (main loop or load generator connection): when it is due and how it kept up
+typedef struct scan_stat {
+    u64 next_ns; // deadline of the next cycle
+
+    u32 cycles;        // cycles polled
+    u32 missed;        // cycles skipped because previous ones ran past their deadline
+    u64 jitter_sum_ns; // how late cycles started comparing to their deadline
+    u64 jitter_max_ns;
+} scan_stat_t;
+
+// plan scan groups polled each with its own period, the most urgent one is on top of min-heap
+typedef struct scan {
+    const plan_t *plan;
+    statistic_t  *stats;  // where missed cycles are accounted
+    scan_stat_t  *groups; // by group index of plan
+    u16          *heap;   // group indices ordered by next_ns
+} scan_t;
+
+int  scan_init(scan_t *s, const plan_t *plan, statistic_t *stats);
+void scan_start(scan_t *s, u64 now);
+int  scan_step(scan_t *s, plan_cursor_t *c, u64 now);
+u64  scan_next_ns(scan_t *s, plan_cursor_t *c);
+void scan_add(scan_stat_t *out, const scan_t *s);
+void scan_log(const plan_t *plan, const scan_stat_t *stats);
+
+#endif
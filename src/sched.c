@@ -0,0 +1,155 @@
+#include <math.h>
+#include <time.h>
+
+#include "profile.h"
+#include "sched.h"
+
+// xorshift64*, every connection has its own so load generator workers don't share a lock
+static u64
+sched_rand(sched_t *s) {
+    s->rand ^= s->rand >> 12;
+    s->rand ^= s->rand << 25;
+    s->rand ^= s->rand >> 27;
+    return s->rand * 0x2545F4914F6CDD1Dull;
+}
+
+// gap to the next request: fixed or exponentially distributed around the period
+static u64
+sched_gap(sched_t *s) {
+    if (s->mode != SCHED_POISSON) {
+        return s->period_ns;
+    }
+
+    // uniform in (0, 1], log of 0 is no good
+    double u = ((sched_rand(s) >> 11) + 1) * (1.0 / 9007199254740992.0);
+    return (u64)(-log(u) * s->period_ns);
+}
+
+// first request is due at first_ns, load generator shifts it per connection so they don't fire together
+void
+sched_start(sched_t *s, sched_mode_t mode, u64 period_ns, u64 first_ns, u64 now) {
+    u64 seed = s->rand;
+
+    *s = (sched_t){
+      .mode      = mode,
+      .period_ns = period_ns,
+      .next_ns   = first_ns,
+      .rand      = seed ? seed : now | 1,
+      .start_ns  = now,
+    };
+}
+
+void
+sched_stop(sched_t *s, u64 now) {
+    if (s->start_ns && !s->stop_ns) {
+        s->stop_ns = now;
+    }
+}
+
+// open loop period follows rate of profile from now on, one share of it
+void
+sched_profile(sched_t *s, const struct profile *profile, int share) {
+    s->profile = profile;
+    s->share   = share;
+}
+
+int
+sched_due(sched_t *s, u64 now) {
+    return now >= s->next_ns;
+}
+
+// request went out, open loop moves to the next arrival no matter when this one was actually sent
+void
+sched_take(sched_t *s, u64 now) {
+    s->issued++;
+
+    if (!sched_open_loop(s->mode)) {
+        return;
+    }
+
+    if (now > s->next_ns + s->period_ns) {
+        s->late++;
+    }
+    if (s->profile) {
+        int phase = 0;
+        int rate  = profile_rate(s->profile, now - s->start_ns, &phase);
+        s->period_ns = (u64)1000000000 * s->share / MAX_VAL(rate, 1);
+    }
+    s->next_ns += sched_gap(s);
+}
+
+// request is done (answered, timed out or just sent, up to the caller), interval mode counts pause from here
+void
+sched_done(sched_t *s, u64 now) {
+    if (s->mode == SCHED_INTERVAL) {
+        s->next_ns = now + s->period_ns;
+    }
+}
+
+// sleep until the next request is due, absolute deadline doesn't drift with time spent before the call
+void
+sched_sleep(sched_t *s) {
+    struct timespec ts = {
+      .tv_sec  = s->next_ns / 1000000000,
+      .tv_nsec = s->next_ns % 1000000000,
+    };
+
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+// mean gap between requests of one pacer, open loop rate is split over count pacers
+u64
+sched_period(sched_mode_t mode, int rate, int timeout_ms, int count) {
+    switch (mode) {
+    case SCHED_INTERVAL: return (u64)timeout_ms * 1000000;
+    case SCHED_RATE:
+    case SCHED_POISSON: return (u64)1000000000 * count / rate;
+    case SCHED_CLOSED:
+    case SCHED_SCAN: return 0;
+    }
+
+    return 0;
+}
+
+int
+sched_open_loop(sched_mode_t mode) {
+    return mode == SCHED_RATE || mode == SCHED_POISSON;
+}
+
+// requests per second actually sent over the run
+double
+sched_achieved(sched_t *s, u64 now) {
+    u64 end = s->stop_ns ? s->stop_ns : now;
+    if (!s->start_ns || end <= s->start_ns) {
+        return 0;
+    }
+
+    return s->issued * 1e9 / (end - s->start_ns);
+}
+
+// open loop: when the request about to be taken was due, it is sent late if client or slave stalled,
+// 0 - request is due when it is sent
+u64
+sched_intended_us(const sched_t *s) {
+    return sched_open_loop(s->mode) ? s->next_ns / 1000 : 0;
+}
+
+// interval mode: stall of request holds back the next ones, they are back filled every period of it,
+// 0 - open loop counts from intended send time instead, closed loop has no rate to compare with
+u64
+sched_backfill_us(const sched_t *s) {
+    return s->mode == SCHED_INTERVAL ? s->period_ns / 1000 : 0;
+}
+
+const char *
+str_sched(sched_mode_t mode) {
+    switch (mode) {
+    case SCHED_INTERVAL: return "interval";
+    case SCHED_RATE: return "fixed rate";
+    case SCHED_POISSON: return "poisson";
+    case SCHED_CLOSED: return "closed loop";
+    case SCHED_SCAN: return "scan table";
+    }
+
+    return "unknown";
+}
@@ -0,0 +1,46 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "types.h"
+
+// how requests are paced
+typedef enum sched_mode {
+    SCHED_INTERVAL, // --timeout of pause after every request
+    SCHED_RATE,     // open loop: --rate requests per second on fixed deadlines, whatever responses do
+    SCHED_POISSON,  // open loop: --rate on average, exponential gaps between requests
+    SCHED_CLOSED,   // closed loop: next request as soon as one in flight is done, --pipeline per connection
+    SCHED_SCAN,     // --plan scan groups: every group is polled on its own period, most urgent first
+} sched_mode_t;
+
+// request pacer, deadlines are absolute so time spent on responses doesn't shift them
+typedef struct sched {
+    sched_mode_t mode;
+
+    u64 period_ns; // mean gap between requests (--timeout for interval mode)
+    u64 next_ns;   // when the next request is due, CLOCK_MONOTONIC
+    u64 rand;      // xorshift state of poisson arrivals
+
+    u64 start_ns; // run started
+    u64 stop_ns;  // run stopped, 0 - still running
+    u64 issued;   // requests sent since start
+    u64 late;     // open loop: requests sent more than one period after they were due
+
+    const struct profile *profile; // --profile: rate follows it, NULL - fixed period
+    int                   share;   // pacers profile rate is split over
+} sched_t;
+
+void        sched_start(sched_t *s, sched_mode_t mode, u64 period_ns, u64 first_ns, u64 now);
+void        sched_stop(sched_t *s, u64 now);
+void        sched_profile(sched_t *s, const struct profile *profile, int share);
+int         sched_due(sched_t *s, u64 now);
+void        sched_take(sched_t *s, u64 now);
+void        sched_done(sched_t *s, u64 now);
+void        sched_sleep(sched_t *s);
+u64         sched_period(sched_mode_t mode, int rate, int timeout_ms, int count);
+int         sched_open_loop(sched_mode_t mode);
+double      sched_achieved(sched_t *s, u64 now);
+u64         sched_intended_us(const sched_t *s);
+u64         sched_backfill_us(const sched_t *s);
+const char *str_sched(sched_mode_t mode);
+
+#endif
@@ -0,0 +1,30 @@
+// termios2 lives in kernel headers which clash with glibc <termios.h>, so it is kept apart from uplink.c
+#include <asm/termbits.h>
+#include <sys/ioctl.h>
+
+#include "serial_baud.h"
+
+// set any baud rate driver supports, not only Bxxx constants, returns rate driver actually applied or -1
+int
+serial_set_baud(int fd, int baud) {
+    struct termios2 tio;
+    if (ioctl(fd, TCGETS2, &tio) < 0) {
+        return -1;
+    }
+
+    tio.c_cflag &= ~(CBAUD | (CBAUD << IBSHIFT));
+    tio.c_cflag |= BOTHER | (BOTHER << IBSHIFT);
+    tio.c_ispeed = baud;
+    tio.c_ospeed = baud;
+
+    if (ioctl(fd, TCSETS2, &tio) < 0) {
+        return -1;
+    }
+
+    // driver rounds rate to what its clock divider can do
+    if (ioctl(fd, TCGETS2, &tio) < 0) {
+        return -1;
+    }
+
+    return tio.c_ospeed;
+}
@@ -0,0 +1,6 @@
+#ifndef SERIAL_BAUD_H
+#define SERIAL_BAUD_H
+
+int serial_set_baud(int fd, int baud);
+
+#endif
@@ -0,0 +1,38 @@
+#include "stats.h"
+#include "types.h"
+
+u32 stats_epoch = 1; // statistic zeroed at start is of epoch 0 and reads as zero until it is written
+
+#define STATS_ZERO(name) __atomic_store_n(&s->name, 0, __ATOMIC_RELAXED);
+#define STATS_SUM(name)  out->name += __atomic_load_n(&s->name, __ATOMIC_RELAXED);
+#define STATS_MAX(name)  out->name = MAX_VAL(out->name, __atomic_load_n(&s->name, __ATOMIC_RELAXED));
+
+// writer's counters of an older epoch start over before anything is added to them,
+// epoch is published last so reader never takes old values for new ones
+statistic_t *
+stats_own(statistic_t *s) {
+    u32 epoch = __atomic_load_n(&stats_epoch, __ATOMIC_RELAXED);
+    if (s->epoch != epoch) {
+        STATS_COUNTERS(STATS_ZERO)
+        STATS_MAXIMA(STATS_ZERO)
+        __atomic_store_n(&s->epoch, epoch, __ATOMIC_RELEASE);
+    }
+    return s;
+}
+
+// merge counters of one runner into out
+void
+stats_read(statistic_t *out, const statistic_t *s) {
+    if (__atomic_load_n(&s->epoch, __ATOMIC_ACQUIRE) != __atomic_load_n(&stats_epoch, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    STATS_COUNTERS(STATS_SUM)
+    STATS_MAXIMA(STATS_MAX)
+}
+
+// every runner zeroes its own counters with the next write, nobody else touches them
+void
+stats_reset(void) {
+    __atomic_add_fetch(&stats_epoch, 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,72 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "types.h"
+
+#define STATS_LINE 64 // cache line, counters of different threads never share one
+
+// X(name): summed over runners
+#define STATS_COUNTERS(X)                                                                                              \
+    X(requests)                                                                                                        \
+    X(success)                                                                                                         \
+    X(timeouts)                                                                                                        \
+    X(fails)                                                                                                           \
+    X(exceptions)     /* exception responses, counted in fails too */                                                 \
+    X(late_responses) /* responses which came after their request timed out */                                       \
+    X(bytes_out)      /* adu bytes of requests */                                                                      \
+    X(bytes_in)       /* adu bytes of responses */                                                                     \
+    X(overshoot_sum_us)                                                                                                \
+    X(gap_violations)                                                                                                  \
+    X(wire_sum_ns)                                                                                                     \
+    X(user_sum_ns)                                                                                                     \
+    X(wire_count)                                                                                                      \
+    X(rsp_sum_us)                                                                                                      \
+    X(rsp_count)                                                                                                       \
+    X(scan_missed)
+
+// X(name): the largest one over runners
+#define STATS_MAXIMA(X)                                                                                                \
+    X(overshoot_max_us)                                                                                                \
+    X(gap_max_us)                                                                                                      \
+    X(wire_max_ns)
+
+#define STATS_FIELD(name) u64 name;
+
+// counters of one runner (main loop or load generator connection), only the thread running it writes them,
+// everyone else merges them with stats_read()
+// overshoot: how late timed out waits actually woke up comparing to response timeout
+// gap: rtu timing, the longest silence inside a frame and frames broken by silence longer than t1.5
+// wire/user: timestamping, request to response time taken by kernel and by us, averaged over wire_count
+// rsp: response time of every answered request
+// scan_missed: scan table, group cycles skipped because earlier ones ran past their deadline
+typedef struct statistic {
+    u32 epoch; // reset counters belong to, stale ones are read as zero
+    STATS_COUNTERS(STATS_FIELD)
+    STATS_MAXIMA(STATS_FIELD)
+} __attribute__((aligned(STATS_LINE))) statistic_t;
+
+extern u32 stats_epoch;
+
+statistic_t *stats_own(statistic_t *s);
+void         stats_read(statistic_t *out, const statistic_t *s);
+void         stats_reset(void);
+
+// writer side: single writer, so plain add is enough, stores are atomic only for readers not to see torn value
+#define STAT_ADD(s, name, n)                                                                                           \
+    do {                                                                                                               \
+        statistic_t *st_ = stats_own(s);                                                                               \
+        __atomic_store_n(&st_->name, st_->name + (n), __ATOMIC_RELAXED);                                               \
+    } while (0)
+
+#define STAT_INC(s, name) STAT_ADD(s, name, 1)
+
+#define STAT_MAX(s, name, v)                                                                                           \
+    do {                                                                                                               \
+        statistic_t *st_ = stats_own(s);                                                                               \
+        u64          v_  = (v);                                                                                        \
+        if (v_ > st_->name) {                                                                                          \
+            __atomic_store_n(&st_->name, v_, __ATOMIC_RELAXED);                                                        \
+        }                                                                                                              \
+    } while (0)
+
+#endif
@@ -0,0 +1,96 @@
+// linux/errqueue.h uses struct timespec without including anything for it
+#include <time.h>
+
+#include <errno.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <string.h>
+#include <sys/socket.h>
+
+#include "tstamp.h"
+
+#define TSTAMP_FLAGS                                                                                                   \
+    (SOF_TIMESTAMPING_TX_SOFTWARE | SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE |                         \
+      SOF_TIMESTAMPING_TX_HARDWARE | SOF_TIMESTAMPING_RX_HARDWARE | SOF_TIMESTAMPING_RAW_HARDWARE |                    \
+      SOF_TIMESTAMPING_OPT_ID | SOF_TIMESTAMPING_OPT_TSONLY)
+
+// ask kernel to timestamp packets of socket when they leave and arrive
+// hardware ones come only if NIC timestamping is switched on for interface (SIOCSHWTSTAMP, ptp4l does it)
+int
+tstamp_enable(int fd) {
+    int flags = TSTAMP_FLAGS;
+    if (setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) < 0) {
+        return RC_FAIL;
+    }
+    return RC_SUCCESS;
+}
+
+// hardware timestamp is preferred, both ends have to come from the same clock to be compared
+static int
+tstamp_from_cmsg(struct msghdr *msg, tstamp_t *out) {
+    for (struct cmsghdr *cm = CMSG_FIRSTHDR(msg); cm; cm = CMSG_NXTHDR(msg, cm)) {
+        if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_TIMESTAMPING) {
+            continue;
+        }
+
+        struct scm_timestamping *ts = (struct scm_timestamping *)CMSG_DATA(cm);
+        if (ts->ts[2].tv_sec || ts->ts[2].tv_nsec) {
+            out->ns = (u64)ts->ts[2].tv_sec * 1000000000 + ts->ts[2].tv_nsec;
+            out->hw = 1;
+        } else {
+            out->ns = (u64)ts->ts[0].tv_sec * 1000000000 + ts->ts[0].tv_nsec;
+            out->hw = 0;
+        }
+        return RC_SUCCESS;
+    }
+
+    return RC_FAIL;
+}
+
+// take every tx timestamp queued on socket's error queue, keep the latest one
+// has to be done regularly: pending error queue keeps fd signalled by poll
+int
+tstamp_drain_tx(int fd, tstamp_t *last) {
+    int got = 0;
+
+    while (1) {
+        u8            control[256];
+        struct msghdr msg = {
+          .msg_control    = control,
+          .msg_controllen = sizeof(control),
+        };
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0) {
+            break;
+        }
+
+        if (tstamp_from_cmsg(&msg, last)) {
+            got++;
+        }
+    }
+
+    return got;
+}
+
+// recv() which also gives kernel timestamp of the data, rx is left untouched if there is none
+int
+tstamp_recv(int fd, u8 *buf, int len, int flags, tstamp_t *rx) {
+    u8           control[256];
+    struct iovec iov = {
+      .iov_base = buf,
+      .iov_len  = len,
+    };
+    struct msghdr msg = {
+      .msg_iov        = &iov,
+      .msg_iovlen     = 1,
+      .msg_control    = control,
+      .msg_controllen = sizeof(control),
+    };
+
+    int rc = recvmsg(fd, &msg, flags);
+    if (rc >= 0) {
+        tstamp_from_cmsg(&msg, rx);
+    }
+
+    return rc;
+}
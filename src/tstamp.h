@@ -0,0 +1,16 @@
+#ifndef TSTAMP_H
+#define TSTAMP_H
+
+#include "types.h"
+
+// kernel timestamp of a packet, 0 - none
+typedef struct tstamp {
+    u64 ns;
+    u8  hw; // taken by NIC, otherwise by network stack
+} tstamp_t;
+
+int tstamp_enable(int fd);
+int tstamp_drain_tx(int fd, tstamp_t *last);
+int tstamp_recv(int fd, u8 *buf, int len, int flags, tstamp_t *rx);
+
+#endif
@@ -1,5 +1,9 @@
+#define _GNU_SOURCE
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
@@ -7,7 +11,13 @@
 
 #include "client_cxt.h"
 #include "helping_hand.h"
+#include "loadgen.h"
+#include "logq.h"
 #include "mb_base.h"
+#include "plan.h"
+#include "profile.h"
+#include "request.h"
+#include "sched.h"
 #include "tui.h"
 #include "types.h"
 #include "uplink.h"
@@ -15,8 +25,17 @@
 pthread_mutex_t mutex;
 global_t       *pglobals;
 
+// input thread sleeps in poll() on stdin, resize has to wake it up through this pipe
+static int              winch_pipe[2] = {-1, -1};
+static struct sigaction ncurses_winch;
+
 log_t logd = {0};
 
+static u8        log_stopped; // terminal is being given back, render thread has to finish
+static pthread_t trender;
+static void     *render_thread(void *arg);
+static void      render_queues(void);
+
 // ======================================================================================
 // CSV LOGS
 // ======================================================================================
@@ -90,12 +109,18 @@ str_baud(int baudrare) {
     case 9600:   return "9600";
     case 19200:  return "19200";
     case 38400:  return "38400";
+    case 57600:  return "57600";
     case 115200: return "115200";
-    default:     return "19200";
+    case 230400: return "230400";
+    case 460800: return "460800";
+    case 921600: return "921600";
     }
     // clang-format on
 
-    return "19200";
+    // custom rate set from command line
+    static char custom[16];
+    snprintf(custom, sizeof(custom), "%d", baudrare);
+    return custom;
 }
 
 const char *
@@ -189,6 +214,67 @@ print_wdata() {
     }
 }
 
+// latency over the run and over the last HIST_WINDOW_S seconds: merged histogram is marked every
+// second, window is what was recorded since the oldest mark
+static hist_t lat_run;
+static hist_t lat_corrected;
+static hist_t lat_window;
+static hist_t lat_marks[HIST_WINDOW_S];
+static int    lat_mark_next;
+static u64    lat_mark_ns;
+
+// fits 5 columns whatever value is
+static void
+str_lat(char *out, int size, u64 us) {
+    if (us < 100000) {
+        snprintf(out, size, "%lu", us);
+    } else if (us < 100000000) {
+        snprintf(out, size, "%lums", us / 1000);
+    } else {
+        snprintf(out, size, "%lus", us / 1000000);
+    }
+}
+
+static void
+print_latency_row(int y, int x, const char *label, const hist_t *h) {
+    hist_sum_t sum = {0};
+    hist_summary(h, &sum);
+
+    u64  vals[7] = {sum.min, sum.mean, sum.p50, sum.p90, sum.p99, sum.p999, sum.max};
+    char cols[7][24]; // u64 in full, str_lat keeps it to 5 columns anyway
+    for (int i = 0; i < 7; i++) {
+        str_lat(cols[i], sizeof(cols[i]), vals[i]);
+    }
+
+    mvwprintw(wheader, y, x, "%-11s %5s %5s %5s %5s %5s %5s %5s", label, cols[0], cols[1], cols[2], cols[3], cols[4],
+      cols[5], cols[6]);
+}
+
+static void
+print_latency(int y, int x) {
+    memset(&lat_run, 0, sizeof(lat_run));
+    memset(&lat_corrected, 0, sizeof(lat_corrected));
+    hist_read(&lat_run, &pglobals->latency);
+    hist_read(&lat_corrected, &pglobals->corrected);
+    loadgen_latency(&lat_run, &lat_corrected);
+
+    u64 now = now_ns();
+    if (now - lat_mark_ns >= 1000000000) {
+        lat_marks[lat_mark_next] = lat_run;
+        lat_mark_next            = (lat_mark_next + 1) % HIST_WINDOW_S;
+        lat_mark_ns              = now;
+    }
+    hist_diff(&lat_window, &lat_run, &lat_marks[lat_mark_next]);
+
+    mvwprintw(wheader, y, x, "%-11s %5s %5s %5s %5s %5s %5s %5s", "Latency, us", "min", "mean", "p50", "p90", "p99",
+      "p99.9", "max");
+    print_latency_row(y + 1, x, "  run", &lat_run);
+    char label[16];
+    snprintf(label, sizeof(label), "  last %d s", HIST_WINDOW_S);
+    print_latency_row(y + 2, x, label, &lat_window);
+    print_latency_row(y + 3, x, "  corrected", &lat_corrected);
+}
+
 void
 redraw_header() {
     // y positions of tui header columns
@@ -211,7 +297,12 @@ redraw_header() {
     } else {
         mvwprintw(wheader, 3, col_1, "3 | Unit IDs: %d-%d", pglobals->slave_id_start, pglobals->slave_id_end);
     }
-    mvwprintw(wheader, 4, col_1, "4 | Function: %s", str_fc(pglobals->cxt.fc));
+    if (pglobals->plan) {
+        mvwprintw(wheader, 4, col_1, "4 | Function: plan of %d steps, %s", pglobals->plan->len,
+          pglobals->plan->total_weight ? "by weight" : "in order");
+    } else {
+        mvwprintw(wheader, 4, col_1, "4 | Function: %s", str_fc(pglobals->cxt.fc));
+    }
 
     mvwprintw(wheader, 6, col_1, "5 | Read address : 0x%04X", pglobals->cxt.raddress);
     mvwprintw(wheader, 7, col_1, "  | Read count   : %d", pglobals->cxt.rcount);
@@ -220,50 +311,194 @@ redraw_header() {
     mvwprintw(wheader, 10, col_1, "6 | Write Data   : ");
     print_wdata(pglobals);
 
+    print_latency(11, col_1);
+
     mvwprintw(wheader, 1, col_2, "F5 | Running: %s", pglobals->running ? "On" : "Off");
     mvwprintw(wheader, 2, col_2, "F6 | Random:  %s", pglobals->random ? "On" : "Off");
 
     mvwprintw(wheader, 4, col_2, "F7 | Fire request sequence:");
     mvwprintw(wheader, 5, col_2, "     %06d / %06d", pglobals->rfire_current, pglobals->rfire_count);
 
-    mvwprintw(wheader, 7, col_2, "F9 | Response timeout: %d ms", pglobals->response_timeout);
-    mvwprintw(wheader, 8, col_2, "   | Send timeout    : %d ms", pglobals->timeout);
+    if (pglobals->adaptive_timeout) {
+        mvwprintw(wheader, 7, col_2, "F9 | Adaptive timeout: %d..%d ms", MIN_VAL(pglobals->rto_min, pglobals->response_timeout),
+          pglobals->response_timeout);
+    } else {
+        mvwprintw(wheader, 7, col_2, "F9 | Response timeout: %d ms", pglobals->response_timeout);
+    }
+    if (pglobals->sched_mode == SCHED_INTERVAL) {
+        mvwprintw(wheader, 8, col_2, "   | Send timeout    : %d ms", pglobals->timeout);
+    } else if (pglobals->profile) {
+        const profile_t *p = pglobals->profile;
+        mvwprintw(wheader, 8, col_2, "   | Phase %2d of %-2d  : %d/s %s", MIN_VAL(p->done + 1, p->len), p->len,
+          pglobals->rate, str_sched(pglobals->sched_mode));
+    } else if (sched_open_loop(pglobals->sched_mode)) {
+        mvwprintw(wheader, 8, col_2, "   | Rate            : %d/s %s", pglobals->rate, str_sched(pglobals->sched_mode));
+    } else if (pglobals->sched_mode == SCHED_SCAN) {
+        mvwprintw(wheader, 8, col_2, "   | Pacing          : %s, %d groups", str_sched(pglobals->sched_mode),
+          pglobals->plan->ngroups);
+    } else {
+        mvwprintw(wheader, 8, col_2, "   | Pacing          : %s", str_sched(pglobals->sched_mode));
+    }
+    if (mb_framing(pglobals->cxt.protocol) == MB_PROTOCOL_TCP) {
+        mvwprintw(wheader, 9, col_2, "   | Pipeline        : %d", pglobals->pipeline);
+    }
+    if (uplink_kind(pglobals->cxt.protocol) == UPLINK_STREAM && !loadgen_active()) {
+        char state[32];
+        link_str_state(uplink_tcp_link(), state, sizeof(state));
+        mvwprintw(wheader, 11, col_2, "Link: %-28s", state);
+    }
+    if (loadgen_active()) {
+        mvwprintw(wheader, 11, col_2, "Load generator: %d conns / %d workers (%s)", pglobals->connections, pglobals->workers,
+          pglobals->backend == IO_BACKEND_URING ? "io_uring" : "epoll");
+        if (pglobals->fleet_len) {
+            int up        = 0;
+            int endpoints = loadgen_endpoints(&up);
+            mvwprintw(wheader, 12, col_2, "Fleet         : %d endpoints, %d up", endpoints, up);
+        }
+    }
+
+    // load generator connections count on their own
+    statistic_t stats = {0};
+    stats_read(&stats, &pglobals->stats);
+    loadgen_stats(&stats);
 
-    int reqs      = pglobals->stats.requests;
-    int successes = pglobals->stats.success;
-    int fails     = pglobals->stats.fails;
-    int timeouts  = pglobals->stats.timeouts;
+    u64 reqs      = stats.requests;
+    u64 successes = stats.success;
+    u64 fails     = stats.fails;
+    u64 timeouts  = stats.timeouts;
 
-    mvwprintw(wheader, 1, col_3, "Requests:  %05d", reqs);
+    mvwprintw(wheader, 1, col_3, "Requests:  %05lu", reqs);
 
     // won't affect real statistic output, but make crude 0 div safeguard
     if (!reqs) {
         reqs = 1;
     }
 
-    mvwprintw(wheader, 2, col_3, "Successed: %05d  %.2f%%", successes, (float)successes / reqs * 100);
-    mvwprintw(wheader, 3, col_3, "Failed:    %05d  %.2f%%", fails, (float)fails / reqs * 100);
-    mvwprintw(wheader, 4, col_3, "Timedout:  %05d  %.2f%%", timeouts, (float)timeouts / reqs * 100);
+    mvwprintw(wheader, 2, col_3, "Successed: %05lu  %.2f%%", successes, (float)successes / reqs * 100);
+    mvwprintw(wheader, 3, col_3, "Failed:    %05lu  %.2f%%", fails, (float)fails / reqs * 100);
+    mvwprintw(wheader, 4, col_3, "Timedout:  %05lu  %.2f%%", timeouts, (float)timeouts / reqs * 100);
+    mvwprintw(wheader, 5, col_3, "Exceptions: %lu, late: %lu", stats.exceptions, stats.late_responses);
 
     mvwprintw(wheader, 6, col_3, "F8 | Reset statistics");
 
+    mvwprintw(wheader, 7, col_3, "F10| Per connection statistics");
+
+    u64 overshoot_avg = stats.overshoot_sum_us / (timeouts ? timeouts : 1);
+    mvwprintw(wheader, 9, col_3, "T/O overshoot: avg %lu us", overshoot_avg);
+    mvwprintw(wheader, 10, col_3, "               max %lu us", stats.overshoot_max_us);
+
+    sched_t sched = pglobals->sched;
+    loadgen_sched(&sched);
+    if (sched_open_loop(sched.mode)) {
+        mvwprintw(wheader, 11, col_3, "Rate: %.1f of %d req/s, %lu late", sched_achieved(&sched, now_ns()), pglobals->rate,
+          sched.late);
+    } else if (sched.mode == SCHED_SCAN) {
+        mvwprintw(wheader, 11, col_3, "Rate: %.1f req/s, %lu cycles missed", sched_achieved(&sched, now_ns()),
+          stats.scan_missed);
+    } else {
+        mvwprintw(wheader, 11, col_3, "Rate: %.1f req/s", sched_achieved(&sched, now_ns()));
+    }
+
+    if (pglobals->rtu_timing && pglobals->cxt.protocol == MB_PROTOCOL_RTU) {
+        mvwprintw(wheader, 12, col_3, "RTU gap: max %lu us", stats.gap_max_us);
+        mvwprintw(wheader, 13, col_3, "         > t1.5: %lu frames", stats.gap_violations);
+    }
+    if (pglobals->timestamping && uplink_kind(pglobals->cxt.protocol) != UPLINK_SERIAL) {
+        u64 n = MAX_VAL(stats.wire_count, 1);
+        mvwprintw(wheader, 12, col_3, "Wire: avg %lu ns, max %lu ns", stats.wire_sum_ns / n, stats.wire_max_ns);
+        mvwprintw(wheader, 13, col_3, "User: avg %lu ns", stats.user_sum_ns / n);
+    }
+
     wrefresh(wheader);
     pthread_mutex_unlock(&mutex);
 }
 
+// line is copied once, nothing is moved when the oldest ones go, call under mutex
+static void
+log_append(const char *line) {
+    int len = strnlen(line, MAX_LINE_LEN - 1);
+    u64 pos = logd.tail;
+
+    // line is never split, the end of arena is skipped instead
+    int at = pos & (LOG_ARENA_LEN - 1);
+    if (at + len > LOG_ARENA_LEN) {
+        pos += LOG_ARENA_LEN - at;
+        at   = 0;
+    }
+    memcpy(&logd.arena[at], line, len);
+    logd.tail = pos + len;
+
+    logd.index[logd.total & (LOG_INDEX_LEN - 1)] = (log_ref_t){.pos = pos, .len = len};
+    logd.total++;
+
+    // drop lines whose index slot or text is taken by the new one
+    while (logd.total - logd.first > LOG_INDEX_LEN ||
+           logd.index[logd.first & (LOG_INDEX_LEN - 1)].pos + LOG_ARENA_LEN < logd.tail) {
+        logd.first++;
+    }
+
+    // view scrolled back stays on the same lines
+    if (logd.scroll) {
+        logd.scroll = MIN_VAL(logd.scroll + 1, logd.total - logd.first);
+    }
+}
+
+// lines view can be scrolled back by, the oldest screen stays full
+static u64
+log_scroll_max(void) {
+    u64 kept = logd.total - logd.first;
+    return kept > (u64)logd.max_rows ? kept - logd.max_rows : 0;
+}
+
 static void
 redraw_log() {
     pthread_mutex_lock(&mutex);
     wclear(wlog);
 
-    for (int i = 0; i < logd.linec; i++) {
-        mvwprintw(wlog, i, 0, "%s", logd.lines[i]);
+    logd.scroll = MIN_VAL(logd.scroll, log_scroll_max());
+
+    u64 end   = logd.total - logd.scroll;
+    u64 start = end - MIN_VAL(end - logd.first, (u64)logd.max_rows);
+    for (u64 i = start; i < end; i++) {
+        log_ref_t *ref = &logd.index[i & (LOG_INDEX_LEN - 1)];
+        mvwprintw(wlog, i - start, 0, "%.*s", ref->len, &logd.arena[ref->pos & (LOG_ARENA_LEN - 1)]);
+    }
+    if (logd.scroll) {
+        mvwprintw(wlog, 0, MAX_VAL(COLS - 44, 0), "[ %lu lines back, PgDn / End to follow ]", logd.scroll);
     }
 
     wrefresh(wlog);
     pthread_mutex_unlock(&mutex);
 }
 
+// rows: lines to scroll back by, negative - forward
+static void
+log_scroll(s64 rows) {
+    pthread_mutex_lock(&mutex);
+    if (rows < 0) {
+        logd.scroll = (u64)-rows < logd.scroll ? logd.scroll + rows : 0;
+    } else {
+        logd.scroll = MIN_VAL(logd.scroll + rows, log_scroll_max());
+    }
+    pthread_mutex_unlock(&mutex);
+
+    redraw_log();
+}
+
+// ncurses turns SIGWINCH into KEY_RESIZE on the next getch(), which has to be called for it
+static void
+on_winch(int sig) {
+    if (ncurses_winch.sa_handler != SIG_DFL && ncurses_winch.sa_handler != SIG_IGN) {
+        ncurses_winch.sa_handler(sig);
+    }
+
+    int saved = errno;
+    if (write(winch_pipe[1], "w", 1) < 0) {
+        // pipe is full, input thread is woken up anyway
+    }
+    errno = saved;
+}
+
 void
 init_tui(global_t *globals) {
     pthread_mutex_init(&mutex, NULL);
@@ -283,14 +518,38 @@ init_tui(global_t *globals) {
     // init logd
     int rows      = LINES - HEADER_BOTTOM;
     logd.max_rows = rows;
-    logd.linel    = COLS;
     wlog          = NEW_WIN(rows, COLS, HEADER_BOTTOM, 0);
     box(wlog, 0, 0);
     redraw_log();
+
+    pthread_create(&trender, NULL, render_thread, NULL);
+
+    if (pipe2(winch_pipe, O_NONBLOCK | O_CLOEXEC) == 0) {
+        struct sigaction sa = {.sa_handler = on_winch, .sa_flags = SA_RESTART};
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGWINCH, &sa, &ncurses_winch);
+    }
 }
 
 void
 destroy_tui() {
+    __atomic_store_n(&log_stopped, TRUE, __ATOMIC_RELAXED);
+
+    // whatever is still queued goes to scrollback and csv, not to screen. render thread which is
+    // exiting does it right away, anyone else waits it out, but not forever: crashed thread may hold mutex
+    int drain = TRUE;
+    if (!pthread_equal(pthread_self(), trender)) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_nsec += 3 * LOG_FRAME_MS * 1000000;
+        ts.tv_sec  += ts.tv_nsec / 1000000000;
+        ts.tv_nsec %= 1000000000;
+
+        drain = pthread_timedjoin_np(trender, NULL, &ts) == 0;
+    }
+    if (drain) {
+        render_queues();
+    }
     pthread_mutex_destroy(&mutex);
 
     delwin(wheader);
@@ -304,7 +563,7 @@ destroy_tui() {
 }
 
 static void
-format_payload(u8 out[MAX_LINE_LEN], u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol) {
+format_payload(u8 out[MAX_LINE_LEN], const u8 *adu, int adu_len, mb_protocol_t protocol) {
     // so we can not to worry about null termination
     memset(out, 0, 1024);
 
@@ -315,51 +574,98 @@ format_payload(u8 out[MAX_LINE_LEN], u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_pro
     }
 }
 
-void
-log_traffic_str(const char *str, dirstat_t ds) {
+// ======================================================================================
+// LOG PIPELINE
+// ======================================================================================
+
+// logging threads only copy records to their queues, render thread formats them and draws log
+// once a frame, so terminal doesn't hold back requests
+
+enum {
+    LOG_TEXT = LOGQ_PAD + 1, // line formatted already
+    LOG_TRAFFIC,             // traffic event without payload, data is its description
+    LOG_ADU,                 // data is adu, protocol it was sent with is in high bits of kind
+    LOG_ERR,                 // line which is also error of the next csv row
+};
+
+// protocol may be switched before record is rendered, so adu keeps its own
+#define LOG_KIND(kind)     ((kind) & 0x0F)
+#define LOG_PROTOCOL(kind) ((mb_protocol_t)((kind) >> 4))
+
+// lines go to scrollback as they are rendered, window is redrawn once at the end of frame whatever burst was
+static int frame_count;
+static u64 log_dropped; // records dropped because render didn't keep up
+
+static void
+frame_line(const char *line) {
+    pthread_mutex_lock(&mutex);
+    log_append(line);
+    pthread_mutex_unlock(&mutex);
+    frame_count++;
+}
+
+static void
+frame_flush(void) {
+    if (!frame_count || __atomic_load_n(&log_stopped, __ATOMIC_RELAXED)) {
+        return;
+    }
+
+    frame_count = 0;
+    redraw_log();
+}
+
+static void
+render_endpoint(const logq_rec_t *rec, char endp[32]) {
+    if (rec->endp_len) {
+        int len = MIN_VAL(rec->endp_len, 31);
+        memcpy(endp, LOGQ_ENDP(rec), len);
+        endp[len] = '\0';
+    } else {
+        str_curr_endpoint(endp, pglobals);
+    }
+}
+
+static void
+render_traffic(const logq_rec_t *rec) {
     u8   buff[MAX_LINE_LEN] = {0};
+    u8   str[MAX_LINE_LEN]  = {0};
     char endp[32]           = {0};
-    str_curr_endpoint(endp, pglobals);
-
-    struct timeval tv;
-    gettimeofday(&tv, NULL); // Get current time with microseconds
-    u64 ms = tv.tv_usec / 1000;
+    render_endpoint(rec, endp);
+    memcpy(str, LOGQ_DATA(rec), MIN_VAL(rec->len, MAX_LINE_LEN - 1));
 
     u8 time[8] = {0};
-    sprintf(time, ".%03lu", ms);
+    sprintf(time, ".%03lu", rec->us % 1000000 / 1000);
 
     // log csv
     if (pglobals->use_csv_log) {
         strcpy(logd.last_err, str);
-        write_csv_log(time, endp, str_dirstat(ds), "<NONE>");
+        write_csv_log(time, endp, str_dirstat(rec->ds), "<NONE>");
     }
 
-    log_linef("%s %s %s <!%s>", time, endp, str_dirstat(ds), str);
+    snprintf(buff, MAX_LINE_LEN, "%s %s %s <!%s>", time, endp, str_dirstat(rec->ds), str);
+    frame_line(buff);
 }
 
-void
-log_adu(u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol, dirstat_t ds) {
+static void
+render_adu(const logq_rec_t *rec) {
     u8   buff[MAX_LINE_LEN] = {0};
     char endp[32]           = {0};
-    str_curr_endpoint(endp, pglobals);
+    render_endpoint(rec, endp);
 
-    struct timeval tv;
-    gettimeofday(&tv, NULL); // Get current time with microseconds
-    u64 ms = tv.tv_usec / 1000;
+    u64 ms = rec->us % 1000000 / 1000;
 
     u8 time[8] = {0};
     sprintf(time, ".%03lu", ms);
 
     u8 left_side[MAX_LINE_LEN] = {0};
-    sprintf(left_side, ".%03luZ %s %s", ms, endp, str_dirstat(ds));
+    sprintf(left_side, ".%03luZ %s %s", ms, endp, str_dirstat(rec->ds));
 
     u8 payload[1024];
-    format_payload(payload, adu, adu_len, protocol);
-    int payload_len = strlen(payload);
+    format_payload(payload, LOGQ_DATA(rec), MIN_VAL(rec->len, MB_MAX_ADU_LEN), LOG_PROTOCOL(rec->kind));
 
     // log csv
     if (pglobals->use_csv_log) {
-        write_csv_log(time, endp, str_dirstat(ds), payload);
+        write_csv_log(time, endp, str_dirstat(rec->ds), payload);
     }
 
     snprintf(buff, MAX_LINE_LEN - 1, "%s %s", left_side, payload);
@@ -371,26 +677,112 @@ log_adu(u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol, dirstat_t d
         // TODO: clamp between COLS and MAX LINE LEN
         line_buff[MAX_LINE_LEN - 1] = '\0';
         memcpy(line_buff, &buff[i * COLS], MAX_LINE_LEN - (i * COLS));
-        log_line(line_buff);
+        frame_line(line_buff);
     }
 }
 
-void
-log_line(const char *line) {
-    strncpy(logd.lines[logd.linec], line, MAX_LINE_LEN - 1);
-    logd.lines[logd.linec][MAX_LINE_LEN - 1] = '\0';
+static void
+render_record(const logq_rec_t *rec) {
+    u8  line[MAX_LINE_LEN] = {0};
+    int len                = MIN_VAL(rec->len, MAX_LINE_LEN - 1);
+
+    switch (LOG_KIND(rec->kind)) {
+    case LOG_TRAFFIC: render_traffic(rec); break;
+    case LOG_ADU: render_adu(rec); break;
+    case LOG_ERR:
+        memcpy(logd.last_err, LOGQ_DATA(rec), len);
+        logd.last_err[len] = '\0';
+        // fallthrough
+    default:
+        memcpy(line, LOGQ_DATA(rec), len);
+        frame_line(line);
+        break;
+    }
+}
 
-    // shift all lines one up if too much, drop top one
-    if (logd.linec == logd.max_rows) {
-        for (int i = 0; i < logd.max_rows; i++) {
-            strncpy(logd.lines[i], logd.lines[i + 1], MAX_LINE_LEN);
+// records of all threads in the order they were made
+static void
+render_queues(void) {
+    while (1) {
+        logq_t     *oldest = NULL;
+        logq_rec_t *first  = NULL;
+
+        for (int i = 0; i < logq_count(); i++) {
+            logq_t     *q   = logq_at(i);
+            logq_rec_t *rec = q ? logq_peek(q) : NULL;
+            if (rec && (!first || rec->us < first->us)) {
+                oldest = q;
+                first  = rec;
+            }
         }
-        logd.linec--;
+        if (!first) {
+            break;
+        }
+
+        render_record(first);
+        logq_pop(oldest);
     }
 
-    logd.linec++;
+    u64 dropped = logq_orphans();
+    for (int i = 0; i < logq_count(); i++) {
+        logq_t *q = logq_at(i);
+        dropped  += q ? __atomic_load_n(&q->dropped, __ATOMIC_RELAXED) : 0;
+    }
+    if (dropped != log_dropped) {
+        u8 line[MAX_LINE_LEN] = {0};
+        snprintf(line, sizeof(line), "! log: %lu records dropped, render can't keep up", dropped - log_dropped);
+        frame_line(line);
+        log_dropped = dropped;
+    }
+}
 
-    redraw_log();
+static void *
+render_thread(void *arg) {
+    // interrupt and terminate are blocked everywhere and taken here between frames, so nobody is
+    // cut off holding mutex and the last records get to log before exit
+    sigset_t quit;
+    sigemptyset(&quit);
+    sigaddset(&quit, SIGINT);
+    sigaddset(&quit, SIGTERM);
+
+    struct timespec frame = {.tv_sec = 0, .tv_nsec = LOG_FRAME_MS * 1000000};
+    while (!__atomic_load_n(&log_stopped, __ATOMIC_RELAXED)) {
+        if (sigtimedwait(&quit, NULL, &frame) > 0) {
+            destroy_tui();
+            exit(0);
+        }
+        render_queues();
+        frame_flush();
+    }
+
+    return NULL;
+}
+
+void
+log_traffic_str_at(const char *endpoint, const char *str, dirstat_t ds) {
+    logq_push(LOG_TRAFFIC, ds, endpoint, str, strlen(str));
+}
+
+void
+log_traffic_str(const char *str, dirstat_t ds) {
+    log_traffic_str_at(NULL, str, ds);
+}
+
+// endpoint: name of endpoint traffic belongs to, NULL - current one
+void
+log_adu_at(const char *endpoint, u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol, dirstat_t ds) {
+    logq_push(LOG_ADU | protocol << 4, ds, endpoint, adu, adu_len);
+}
+
+void
+log_adu(u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol, dirstat_t ds) {
+    log_adu_at(NULL, adu, adu_len, protocol, ds);
+}
+
+void
+log_line(const char *line) {
+    // can be called from load generator workers as well, every thread has its own queue
+    logq_push(LOG_TEXT, 0, NULL, line, strnlen(line, MAX_LINE_LEN - 1));
 }
 
 void
@@ -407,12 +799,14 @@ log_linef(const char *format, ...) {
 
 void
 log_req_errf(const char *format, ...) {
+    u8 buff[MAX_LINE_LEN] = {0};
+
     va_list va;
     va_start(va, format);
-    vsnprintf(logd.last_err, MAX_LINE_LEN, format, va);
+    vsnprintf(buff, MAX_LINE_LEN, format, va);
     va_end(va);
 
-    log_line(logd.last_err);
+    logq_push(LOG_ERR, 0, NULL, buff, strlen(buff));
 }
 
 // =============================================================================
@@ -451,9 +845,27 @@ char *field_enum_baud[] = {
   "38400",  //
   "57600",  //
   "115200", //
+  "230400", //
+  "460800", //
+  "921600", //
+  NULL,     // custom rate from command line goes here
   NULL,
 };
 
+// keep custom rate selectable, otherwise enum field won't accept current value
+static void
+field_enum_baud_custom(int baud) {
+    const char *str = str_baud(baud);
+
+    int i = 0;
+    for (; field_enum_baud[i]; i++) {
+        if (strcmp(field_enum_baud[i], str) == 0) {
+            return;
+        }
+    }
+    field_enum_baud[i] = (char *)str;
+}
+
 char *field_enum_dbits[] = {
   "5",
   "6",
@@ -478,8 +890,8 @@ char *field_enum_parity[] = {
 void
 tui_endpoint_draw(WINDOW *win, FORM *form) {
     box(win, 0, 0);
-    if (pglobals->cxt.protocol == MB_PROTOCOL_TCP) {
-        mvwprintw(win, 0, 1, "TCP Endpoint");
+    if (uplink_kind(pglobals->cxt.protocol) != UPLINK_SERIAL) {
+        mvwprintw(win, 0, 1, "%s Endpoint", str_protocol(pglobals->cxt.protocol));
         mvwprintw(win, 1, 1, "Host:   ");
         mvwprintw(win, 2, 1, "Port:   ");
 
@@ -511,7 +923,7 @@ tui_endpoint() {
     //   nfields  h           w          y              x
     TUIDW_HEAD(5, win_height, win_width, LINES / 2 - 5, COLS / 2 - 16)
 
-    if (pglobals->cxt.protocol == MB_PROTOCOL_TCP) {
+    if (uplink_kind(pglobals->cxt.protocol) != UPLINK_SERIAL) {
         // host field    i  h  w                 y  x  val
         TUIDW_FIELD_TEXT(0, 1, input_field_lane, 0, 0, pglobals->tcp_endp.host)
         // port field   i  h  w                 y  x  z  mn mx     val
@@ -521,6 +933,7 @@ tui_endpoint() {
     } else {
         // device field  i  h  w                 y  x  val
         TUIDW_FIELD_TEXT(0, 1, input_field_lane, 0, 0, pglobals->sconf.device)
+        field_enum_baud_custom(pglobals->sconf.baud);
         // baud field    i  h  w                 y  x  enum             val
         TUIDW_FIELD_ENUM(1, 1, input_field_lane, 1, 0, field_enum_baud, str_baud(pglobals->sconf.baud))
         // data bits field
@@ -553,7 +966,7 @@ tui_endpoint() {
                 continue;
             }
 
-            if (pglobals->cxt.protocol == MB_PROTOCOL_TCP) {
+            if (uplink_kind(pglobals->cxt.protocol) != UPLINK_SERIAL) {
                 tcp_endp tcp = {0};
                 if (tcp_ednp_from_str(&tcp, field_buffer(field[0], 0), field_buffer(field[1], 0))) {
                     memcpy(&pglobals->tcp_endp, &tcp, sizeof(tcp));
@@ -709,10 +1122,10 @@ tui_uid() {
             char *buff1 = field_buffer(field[1], 0);
             char *buff2 = field_buffer(field[2], 0);
             if (uid_from_str(&start, &end, buff1, buff2, sequence)) {
-                pglobals->slave_id_start = start;
-                pglobals->slave_id_end   = end;
-                pglobals->sequence_uid   = sequence;
-                pglobals->current_uid    = start;
+                pglobals->slave_id_start  = start;
+                pglobals->slave_id_end    = end;
+                pglobals->sequence_uid    = sequence;
+                pglobals->cxt.current_uid = start;
                 close_dialog(win, form, field, nfields);
                 return;
             } else {
@@ -781,6 +1194,7 @@ tui_fc() {
         } else if (ch >= KEY_1 && ch <= KEY_9) {
             // ladies and gentelmens, we got him
             pglobals->cxt.fc = ind_to_fc(ch - KEY_1);
+            request_invalidate();
             redraw_header();
             break;
         }
@@ -849,6 +1263,7 @@ tui_qty_addr() {
                 pglobals->cxt.rcount   = rcount;
                 pglobals->cxt.waddress = waddr;
                 pglobals->cxt.wcount   = wcount;
+                request_invalidate();
                 close_dialog(win, form, field, nfields);
                 return;
             } else {
@@ -989,6 +1404,7 @@ tui_wdata() {
         case KEY_F(1): {
             if (form_driver(form, REQ_VALIDATION) == E_OK) {
                 wdata_from_str(pglobals, field_buffer(field[0], 0));
+                request_invalidate();
                 close_dialog(win, form, field, nfields);
                 return;
             }
@@ -1064,9 +1480,20 @@ tui_fsequence() {
 
 void *
 input_thread() {
+    struct pollfd fds[2] = {
+      {.fd = STDIN_FILENO, .events = POLLIN},
+      {.fd = winch_pipe[0], .events = POLLIN},
+    };
+
     while (1) {
         int key = getch();
         if (key == ERR) {
+            // nothing buffered, sleep until a key is pressed or terminal is resized
+            if (poll(fds, 2, -1) > 0 && (fds[1].revents & POLLIN)) {
+                char drain[16];
+                while (read(winch_pipe[0], drain, sizeof(drain)) > 0) {
+                }
+            }
             continue;
         }
 
@@ -1087,14 +1514,8 @@ input_thread() {
             wresize(wheader, HEADER_BOTTOM, COLS);
             redraw_header(pglobals);
 
-            // restructure log, drop older lines if they doesn't fit in new line count
+            // log shows as much of the newest lines as fits now
             logd.max_rows = LINES - HEADER_BOTTOM;
-            if (logd.linec >= logd.max_rows) {
-                for (int i = 0; i < logd.max_rows; i++) {
-                    strncpy(logd.lines[i], logd.lines[i + 1], MAX_LINE_LEN);
-                }
-                logd.linec--;
-            }
 
             // resize and redraw header
             wresize(wlog, LINES - HEADER_BOTTOM, COLS);
@@ -1103,13 +1524,28 @@ input_thread() {
             continue;
         }
 
-        // TUI shouldn't change anything while client actualy running requests
-        if (pglobals->running && key != KEY_F(5)) {
+        // log can be scrolled whatever client does
+        if (key == KEY_PPAGE || key == KEY_NPAGE || key == KEY_HOME || key == KEY_END) {
+            s64 page = MAX_VAL(logd.max_rows - 1, 1);
+            switch (key) {
+            case KEY_PPAGE: log_scroll(page); break;
+            case KEY_NPAGE: log_scroll(-page); break;
+            case KEY_HOME: log_scroll(LOG_INDEX_LEN); break;
+            case KEY_END: log_scroll(-(s64)LOG_INDEX_LEN); break;
+            }
+            continue;
+        }
+
+        // TUI shouldn't change anything while client actualy running requests, statistic can be reset any time
+        if (pglobals->running && key != KEY_F(5) && key != KEY_F(8) && key != KEY_F(10)) {
             continue;
         }
 
         switch (key) {
-        case KEY_1: pglobals->cxt.protocol = (pglobals->cxt.protocol + 1) % MB_PROTOCOL_MAX; break;
+        case KEY_1:
+            pglobals->cxt.protocol = (pglobals->cxt.protocol + 1) % MB_PROTOCOL_MAX;
+            request_invalidate();
+            break;
         case KEY_2: tui_endpoint(); break;
         case KEY_3: tui_uid(); break;
         case KEY_4: tui_fc(); break;
@@ -1127,19 +1563,24 @@ input_thread() {
             pglobals->running = ~pglobals->running;
             break;
 
-        case KEY_F(6): pglobals->random = ~pglobals->random; break;
+        case KEY_F(6):
+            // template compiled with random data must not be reused with fixed one
+            pglobals->random = ~pglobals->random;
+            request_invalidate();
+            break;
         case KEY_F(7): tui_fsequence(); break;
         case KEY_F(8):
-            pglobals->stats.requests = 0;
-            pglobals->stats.success  = 0;
-            pglobals->stats.timeouts = 0;
-            pglobals->stats.fails    = 0;
+            stats_reset();
             redraw_header(pglobals);
             break;
 
         case KEY_F(9): tui_timeouts(pglobals); break;
+        case KEY_F(10): loadgen_log_stats(); break;
         }
 
+        // run could be started or connection changed, idle main loop and workers have to look at it
+        uplink_wake();
+        loadgen_wake();
         redraw_header(pglobals);
     }
 }
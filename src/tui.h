@@ -7,6 +7,7 @@
 #include "client_cxt.h"
 
 #define HEADER_BOTTOM 16 // header bottom position in y coords
+#define LOG_FRAME_MS  33 // log is drawn this often, whatever rate of records is
 
 #define CSV_IND_CAP   8
 #define CSV_LINES_CAP 1023
@@ -78,14 +79,26 @@
 #define KEY_9 57
 #define KEY_0 48
 
-#define MAX_LINES    64
-#define MAX_LINE_LEN 1024
+#define MAX_LINE_LEN  1024
+#define LOG_ARENA_LEN (16 << 20) // power of 2, bytes of line text kept for scrollback
+#define LOG_INDEX_LEN (1 << 18)  // power of 2, lines kept for scrollback
 
+// where line text is in arena
+typedef struct log_ref {
+    u64 pos; // arena byte, runs freely, so overwritten text is told by it
+    u16 len;
+} log_ref_t;
+
+// scrollback: lines are appended to arena and index one after another, the oldest ones are overwritten
 typedef struct log {
-    u8 linel;
-    u8 linec;
-    u8 max_rows;
-    s8 lines[MAX_LINES][MAX_LINE_LEN];
+    int max_rows; // lines log window shows
+    u64 total;    // lines ever appended, number of the next one
+    u64 first;    // the oldest line which is still kept
+    u64 scroll;   // lines view is scrolled back from the newest one, 0 - view follows new lines
+    u64 tail;     // next arena byte to write, runs freely
+
+    log_ref_t index[LOG_INDEX_LEN];
+    s8        arena[LOG_ARENA_LEN];
 
     // csv log
     u8    last_err[MAX_LINE_LEN];
@@ -108,7 +121,9 @@ void *input_thread();
 void  log_line(const char *line);
 void  log_linef(const char *format, ...);
 void  log_traffic_str(const char *str, dirstat_t ds);
+void  log_traffic_str_at(const char *endpoint, const char *str, dirstat_t ds);
 void  log_adu(u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol, dirstat_t ds);
+void  log_adu_at(const char *endpoint, u8 adu[MB_MAX_ADU_LEN], int adu_len, mb_protocol_t protocol, dirstat_t ds);
 void  log_req_errf(const char *format, ...);
 
 #endif
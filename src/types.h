@@ -114,6 +114,8 @@ typedef enum {
     MB_PROTOCOL_RTU,
     MB_PROTOCOL_ASCII,
     MB_PROTOCOL_TCP,
+    MB_PROTOCOL_UDP,     // mbap adu per datagram
+    MB_PROTOCOL_RTU_TCP, // rtu frames over raw tcp, as serial to ethernet converters do
     MB_PROTOCOL_MAX,
 } mb_protocol_t;
 
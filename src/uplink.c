@@ -1,17 +1,31 @@
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/serial.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <termios.h>
 #include <unistd.h>
 
+#include "helping_hand.h"
+#include "link.h"
+#include "serial_baud.h"
+#include "tstamp.h"
 #include "tui.h"
 #include "types.h"
 #include "uplink.h"
 
+static link_t tcp_link;    // main loop connection, cxt.fd while it is up
+static link_t tcp_standby; // --standby: spare connection to take over when tcp_link drops
+static u8     tcp_reset;   // relink() asked main loop to reopen tcp_link
+static int    wake_fd = -1; // eventfd tui wakes idle main loop up with
+
 static int
 get_baud(int baud) {
     switch (baud) {
@@ -33,6 +47,9 @@ get_baud(int baud) {
     case 38400: return B38400;
     case 57600: return B57600;
     case 115200: return B115200;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
     }
 
     return RC_FAIL;
@@ -52,10 +69,18 @@ open_serial(serial_cfg *sconf) {
         return RC_ERROR;
     }
 
-    // baud
+    // rtu is binary, no line editing, translation or echo
+    cfmakeraw(&tty);
+    tty.c_cflag    |= CLOCAL | CREAD;
+    tty.c_cc[VMIN]  = 1; // with 0 nonblocking read returns 0 instead of EAGAIN
+    tty.c_cc[VTIME] = 0;
+
+    // baud, non-standard rates are set with termios2 below
     int baud = get_baud(sconf->baud);
-    cfsetispeed(&tty, baud);
-    cfsetospeed(&tty, baud);
+    if (baud != RC_FAIL) {
+        cfsetispeed(&tty, baud);
+        cfsetospeed(&tty, baud);
+    }
 
     // parity
     switch (sconf->parity) {
@@ -73,6 +98,7 @@ open_serial(serial_cfg *sconf) {
     }
 
     // data bits
+    tty.c_cflag &= ~CSIZE;
     switch (sconf->data_bits) {
     case 5: tty.c_cflag |= CS5; break;
     case 6: tty.c_cflag |= CS6; break;
@@ -93,76 +119,161 @@ open_serial(serial_cfg *sconf) {
         return RC_ERROR;
     }
 
+    // whatever rate it is, ask driver for it directly and see what it really gave
+    sconf->baud_actual = serial_set_baud(fd, sconf->baud);
+    if (sconf->baud_actual < 0) {
+        if (baud == RC_FAIL) {
+            log_linef("! failed to set baud %d: %s", sconf->baud, strerror(errno));
+            close(fd);
+            return RC_ERROR;
+        }
+        sconf->baud_actual = sconf->baud;
+    } else if (sconf->baud_actual != sconf->baud) {
+        log_linef("! baud %d requested, driver applied %d", sconf->baud, sconf->baud_actual);
+    } else {
+        log_linef("> baud %d applied", sconf->baud_actual);
+    }
+
+    // driver shouldn't hold bytes back, otherwise gaps between them can't be measured
+    struct serial_struct ss;
+    if (ioctl(fd, TIOCGSERIAL, &ss) == 0) {
+        ss.flags |= ASYNC_LOW_LATENCY;
+        ioctl(fd, TIOCSSERIAL, &ss);
+    }
+
     log_linef("> openned serial connection (fd: %d)", fd);
 
     return fd;
 }
 
+// time to transmit one character: start bit, data, parity and stop bits
+u32
+serial_char_us(serial_cfg *sconf) {
+    int parity = sconf->parity == 'E' || sconf->parity == 'e' || sconf->parity == 'O' || sconf->parity == 'o';
+    int bits   = 1 + sconf->data_bits + parity + sconf->stop_bits;
+
+    int baud   = sconf->baud_actual > 0 ? sconf->baud_actual : sconf->baud;
+
+    return baud ? (u64)bits * 1000000 / baud : 0;
+}
+
+// t1.5 and t3.5 silent intervals of rtu, above 19200 baud spec fixes them to 750 and 1750 us
+void
+serial_char_times(serial_cfg *sconf, u32 *t15_us, u32 *t35_us) {
+    if ((sconf->baud_actual > 0 ? sconf->baud_actual : sconf->baud) > 19200) {
+        *t15_us = 750;
+        *t35_us = 1750;
+        return;
+    }
+
+    *t15_us = serial_char_us(sconf) * 3 / 2;
+    *t35_us = serial_char_us(sconf) * 7 / 2;
+}
+
+// what carries protocol's frames
+uplink_kind_t
+uplink_kind(mb_protocol_t protocol) {
+    switch (protocol) {
+    case MB_PROTOCOL_TCP:
+    case MB_PROTOCOL_RTU_TCP: return UPLINK_STREAM;
+    case MB_PROTOCOL_UDP: return UPLINK_DGRAM;
+    default: return UPLINK_SERIAL;
+    }
+}
+
+// connected udp socket: plain read/write work on it and icmp errors come back as ECONNREFUSED
 int
-open_tcp(tcp_endp *endp) {
-    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | O_NONBLOCK, 0);
+open_udp(tcp_endp *endp) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
     if (fd < 0) {
-        log_linef("! failed to create tcp connection: %s", strerror(errno));
+        log_linef("! failed to create udp socket: %s", strerror(errno));
         return RC_ERROR;
     }
 
-    in_addr_t ip_addr = inet_addr(endp->host);
-
     struct sockaddr_in sa = {
       .sin_family      = AF_INET,
       .sin_port        = htons(endp->tcp_port),
-      .sin_addr.s_addr = ip_addr,
+      .sin_addr.s_addr = inet_addr(endp->host),
     };
 
     if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
-        if (errno != EINPROGRESS) {
-            log_linef("! failed to connect socket (fd: %s)", strerror(errno));
-            close(fd);
-            return RC_ERROR;
-        }
-    }
-
-    u8  buff[1] = {0};
-    // should return 0 and errno WOULDBLOCK or EAGAIN
-    int rc      = write(fd, buff, 0);
-    if (rc < 0) {
-        if (errno != EWOULDBLOCK && errno != EAGAIN) {
-            close(fd);
-            return RC_ERROR;
-        }
+        log_linef("! failed to set udp peer %s:%d: %s", endp->host, endp->tcp_port, strerror(errno));
+        close(fd);
+        return RC_ERROR;
     }
 
-    log_linef("> oppened tcp connection (fd: %d): %s:%d", fd, endp->host, endp->tcp_port);
-
     return fd;
 }
 
+// new socket becomes main uplink, --timestamping is switched on once here, not per request
+static void
+uplink_adopt(global_t *global, int fd) {
+    if (global->timestamping && fd != global->cxt.fd && tstamp_enable(fd) != RC_SUCCESS) {
+        log_linef("! failed to enable timestamping (fd: %d): %s", fd, strerror(errno));
+    }
+    global->cxt.fd = fd;
+}
+
 int
 open_uplink(global_t *global) {
-    int fd;
+    int fd = -1;
 
-    switch (global->cxt.protocol) {
-    case MB_PROTOCOL_RTU:
-    case MB_PROTOCOL_ASCII: fd = open_serial(&global->sconf); break;
-    case MB_PROTOCOL_TCP: fd = open_tcp(&global->tcp_endp); break;
+    if (wake_fd < 0) {
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    }
+
+    switch (uplink_kind(global->cxt.protocol)) {
+    case UPLINK_SERIAL: fd = open_serial(&global->sconf); break;
+    case UPLINK_DGRAM:
+        fd = open_udp(&global->tcp_endp);
+        if (fd >= 0) {
+            log_linef("> openned udp socket (fd: %d): %s:%d", fd, global->tcp_endp.host, global->tcp_endp.tcp_port);
+        }
+        break;
+    case UPLINK_STREAM:
+        // main loop connects with uplink_tcp_ready(), which never blocks for long
+        link_init(&tcp_link, &global->tcp_endp);
+        link_init(&tcp_standby, &global->tcp_endp);
+        return RC_SUCCESS;
     }
 
     if (fd < 0) {
         return RC_FAIL;
     }
 
-    global->cxt.fd = fd;
+    if (uplink_kind(global->cxt.protocol) == UPLINK_SERIAL) {
+        global->cxt.fd = fd;
+    } else {
+        uplink_adopt(global, fd);
+    }
     return RC_SUCCESS;
 }
 
 int
 relink(global_t *global) {
+    log_linef("> reopening connection");
+
+    if (uplink_kind(global->cxt.protocol) == UPLINK_STREAM) {
+        // serial or udp connection we are switching from
+        if (global->cxt.fd > 2 && global->cxt.fd != tcp_link.fd) {
+            close(global->cxt.fd);
+            global->cxt.fd = -1;
+        }
+
+        // tui calls this too while main loop may be connecting, so link is reopened by main loop itself
+        tcp_reset                   = TRUE;
+        global->cxt.last_run_was_on = global->cxt.protocol;
+        return RC_SUCCESS;
+    }
+
     // if something opened, close it
-    if (global->cxt.fd > 2) { // 0 - stdin, 1 - stdout, 2 - stderr
+    if (global->cxt.fd > 2 && global->cxt.fd != tcp_link.fd) { // 0 - stdin, 1 - stdout, 2 - stderr
         close(global->cxt.fd);
     }
+    global->cxt.fd = -1;
+    link_close(&tcp_link);
+    link_close(&tcp_standby);
 
-    log_linef("> reopening connection");
     // reopen new socket
     if (open_uplink(global)) {
         global->cxt.last_run_was_on = global->cxt.protocol;
@@ -171,3 +282,156 @@ relink(global_t *global) {
         return RC_FAIL;
     }
 }
+
+static int
+uplink_wait(int fd, short events, u64 deadline_us) {
+    struct pollfd pfd = {
+      .fd     = fd,
+      .events = events,
+    };
+
+    while (1) {
+        u64 now = now_us();
+        if (now >= deadline_us) {
+            return RC_FAIL;
+        }
+
+        // ppoll takes timespec, so we don't lose precision rounding up to ms like poll does
+        u64             left = deadline_us - now;
+        struct timespec ts   = {
+            .tv_sec  = left / 1000000,
+            .tv_nsec = (left % 1000000) * 1000,
+        };
+
+        int rc = ppoll(&pfd, 1, &ts, NULL);
+        if (rc > 0) {
+            return RC_SUCCESS;
+        } else if (rc == 0) {
+            return RC_FAIL;
+        } else if (errno != EINTR) {
+            return RC_ERROR;
+        }
+    }
+}
+
+// sleep until fd has something to read or deadline (monotonic, us) passes, returns:
+//  RC_SUCCESS - fd is readable (or has error/hangup pending, next read will tell)
+//  RC_FAIL    - deadline passed
+//  RC_ERROR   - poll failed
+int
+uplink_wait_readable(int fd, u64 deadline_us) {
+    return uplink_wait(fd, POLLIN, deadline_us);
+}
+
+// same as uplink_wait_readable, but for space in send buffer
+int
+uplink_wait_writable(int fd, u64 deadline_us) {
+    return uplink_wait(fd, POLLOUT, deadline_us);
+}
+
+// drive main tcp connection without blocking longer than deadline, returns:
+//  RC_SUCCESS - connection is up, cxt.fd is set
+//  RC_FAIL    - still connecting or waiting out backoff, try again later
+int
+uplink_tcp_ready(global_t *global, u64 deadline_us) {
+    link_t *l   = &tcp_link;
+    u64     now = now_us();
+
+    if (tcp_reset) {
+        tcp_reset = FALSE;
+        if (global->cxt.fd == l->fd) {
+            global->cxt.fd = -1;
+        }
+        link_close(l);
+        link_close(&tcp_standby);
+        link_init(l, &global->tcp_endp);
+        link_init(&tcp_standby, &global->tcp_endp);
+    }
+
+    // fd was closed on read or write error
+    if (l->state == LINK_UP && global->cxt.fd != l->fd) {
+        link_lost(l, now);
+        if (global->standby) {
+            link_take(l, &tcp_standby);
+        }
+    }
+
+    if (global->standby) {
+        link_step(&tcp_standby, now);
+    }
+
+    link_start(l, now);
+    if (l->state == LINK_CONNECTING) {
+        uplink_wait_writable(l->fd, MIN_VAL(deadline_us, link_next_us(l)));
+        link_check(l, now_us());
+    } else if (l->state == LINK_BACKOFF) {
+        // nothing to poll, ppoll just sleeps on negative fd
+        uplink_wait_readable(-1, MIN_VAL(deadline_us, l->retry_us));
+    }
+
+    if (l->state != LINK_UP) {
+        return RC_FAIL;
+    }
+
+    uplink_adopt(global, l->fd);
+    return RC_SUCCESS;
+}
+
+// idle main loop sleeps here until tui wakes it up, keep_tcp - main tcp connection is kept going meanwhile
+void
+uplink_idle(global_t *global, int keep_tcp) {
+    struct pollfd fds[3] = {
+      {.fd = wake_fd, .events = POLLIN},
+    };
+    int nfds     = 1;
+    u64 deadline = 0;
+
+    if (keep_tcp) {
+        uplink_tcp_ready(global, now_us());
+
+        // connects in progress are waited for, backoffs and connect timeouts are slept out
+        link_t *links[] = {&tcp_link, global->standby ? &tcp_standby : NULL};
+        for (int i = 0; i < 2 && links[i]; i++) {
+            if (links[i]->state == LINK_CONNECTING) {
+                fds[nfds++] = (struct pollfd){.fd = links[i]->fd, .events = POLLOUT};
+            }
+
+            u64 next = link_next_us(links[i]);
+            if (next && (!deadline || next < deadline)) {
+                deadline = next;
+            }
+        }
+    }
+
+    struct timespec  ts  = {0};
+    struct timespec *pts = NULL;
+    if (deadline) {
+        u64 now  = now_us();
+        u64 left = deadline > now ? deadline - now : 0;
+
+        ts.tv_sec  = left / 1000000;
+        ts.tv_nsec = (left % 1000000) * 1000;
+        pts        = &ts;
+    }
+
+    if (ppoll(fds, nfds, pts, NULL) > 0 && (fds[0].revents & POLLIN)) {
+        u64 count;
+        if (read(wake_fd, &count, sizeof(count)) < 0) {
+            // nonblocking, somebody else took it
+        }
+    }
+}
+
+// tui did something idle main loop has to look at: started a run, changed endpoint
+void
+uplink_wake(void) {
+    u64 one = 1;
+    if (wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) {
+        // counter is full, main loop is woken up anyway
+    }
+}
+
+link_t *
+uplink_tcp_link(void) {
+    return &tcp_link;
+}
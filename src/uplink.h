@@ -2,8 +2,29 @@
 #define UPLINK_H
 
 #include "client_cxt.h"
+#include "link.h"
 
+typedef enum uplink_kind {
+    UPLINK_SERIAL,
+    UPLINK_STREAM, // tcp
+    UPLINK_DGRAM,  // udp
+} uplink_kind_t;
+
+uplink_kind_t uplink_kind(mb_protocol_t protocol);
+
+int open_udp(tcp_endp *endp);
 int open_uplink(global_t *global);
 int relink(global_t *global);
+int uplink_wait_readable(int fd, u64 deadline_us);
+int uplink_wait_writable(int fd, u64 deadline_us);
+int uplink_tcp_ready(global_t *global, u64 deadline_us);
+
+void uplink_idle(global_t *global, int keep_tcp);
+void uplink_wake(void);
+
+link_t *uplink_tcp_link(void);
+
+u32  serial_char_us(serial_cfg *sconf);
+void serial_char_times(serial_cfg *sconf, u32 *t15_us, u32 *t35_us);
 
 #endif
@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "helping_hand.h"
+#include "uring.h"
+
+static int
+sys_setup(u32 entries, struct io_uring_params *p) {
+    return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_enter(int fd, u32 to_submit, u32 min_complete, u32 flags, void *arg, size_t arg_size) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static int
+sys_register(int fd, u32 opcode, void *arg, u32 nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+// ======================================================================================
+// Setup
+// ======================================================================================
+
+static int
+uring_map(uring_t *r, struct io_uring_params *p) {
+    r->sq_size   = p->sq_off.array + p->sq_entries * sizeof(u32);
+    r->cq_size   = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+    r->sqes_size = p->sq_entries * sizeof(struct io_uring_sqe);
+
+    // since 5.4 both queues live in one mapping
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        r->sq_size = r->cq_size = MAX_VAL(r->sq_size, r->cq_size);
+    }
+
+    r->sq_ptr = mmap(0, r->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_ptr == MAP_FAILED) {
+        r->sq_ptr = NULL;
+        return RC_ERROR;
+    }
+
+    if (p->features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_ptr = r->sq_ptr;
+    } else {
+        r->cq_ptr = mmap(0, r->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_ptr == MAP_FAILED) {
+            r->cq_ptr = NULL;
+            return RC_ERROR;
+        }
+    }
+
+    r->sqes = mmap(0, r->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        return RC_ERROR;
+    }
+
+    u8 *sq = r->sq_ptr;
+    u8 *cq = r->cq_ptr;
+
+    r->sq_head    = (u32 *)(sq + p->sq_off.head);
+    r->sq_tail    = (u32 *)(sq + p->sq_off.tail);
+    r->sq_mask    = *(u32 *)(sq + p->sq_off.ring_mask);
+    r->sq_entries = p->sq_entries;
+    r->cq_head    = (u32 *)(cq + p->cq_off.head);
+    r->cq_tail    = (u32 *)(cq + p->cq_off.tail);
+    r->cq_mask    = *(u32 *)(cq + p->cq_off.ring_mask);
+    r->cqes       = (struct io_uring_cqe *)(cq + p->cq_off.cqes);
+
+    // sqe slots are used in order, so indirection array is identity
+    u32 *array = (u32 *)(sq + p->sq_off.array);
+    for (u32 i = 0; i < r->sq_entries; i++) {
+        array[i] = i;
+    }
+
+    r->sqe_tail  = *r->sq_tail;
+    r->submitted = r->sqe_tail;
+
+    return RC_SUCCESS;
+}
+
+// register buffers kernel fills on multishot receive, so no receive has to be rearmed per response
+static int
+uring_setup_bufs(uring_t *r) {
+    size_t ring_size = URING_BUF_COUNT * sizeof(struct io_uring_buf);
+
+    r->br = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (r->br == MAP_FAILED) {
+        r->br = NULL;
+        return RC_ERROR;
+    }
+
+    r->bufs = malloc(URING_BUF_COUNT * URING_BUF_LEN);
+    if (!r->bufs) {
+        return RC_ERROR;
+    }
+
+    struct io_uring_buf_reg reg = {
+      .ring_addr    = (u64)(unsigned long)r->br,
+      .ring_entries = URING_BUF_COUNT,
+      .bgid         = URING_BUF_GROUP,
+    };
+    if (sys_register(r->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return RC_ERROR;
+    }
+
+    r->br_tail = 0;
+    for (int i = 0; i < URING_BUF_COUNT; i++) {
+        uring_buf_recycle(r, i);
+    }
+
+    return RC_SUCCESS;
+}
+
+int
+uring_init(uring_t *r) {
+    memset(r, 0, sizeof(*r));
+
+    struct io_uring_params p = {
+      .flags = IORING_SETUP_COOP_TASKRUN,
+    };
+
+    r->fd = sys_setup(URING_ENTRIES, &p);
+    if (r->fd < 0 && errno == EINVAL) {
+        // older kernel, go without flags
+        memset(&p, 0, sizeof(p));
+        r->fd = sys_setup(URING_ENTRIES, &p);
+    }
+    if (r->fd < 0) {
+        return RC_ERROR;
+    }
+
+    if (uring_map(r, &p) != RC_SUCCESS || uring_setup_bufs(r) != RC_SUCCESS) {
+        int err = errno;
+        uring_free(r);
+        errno = err;
+        return RC_ERROR;
+    }
+
+    return RC_SUCCESS;
+}
+
+void
+uring_free(uring_t *r) {
+    if (r->sqes) {
+        munmap(r->sqes, r->sqes_size);
+    }
+    if (r->cq_ptr && r->cq_ptr != r->sq_ptr) {
+        munmap(r->cq_ptr, r->cq_size);
+    }
+    if (r->sq_ptr) {
+        munmap(r->sq_ptr, r->sq_size);
+    }
+    if (r->br) {
+        munmap(r->br, URING_BUF_COUNT * sizeof(struct io_uring_buf));
+    }
+    free(r->bufs);
+
+    if (r->fd >= 0) {
+        close(r->fd);
+    }
+
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+}
+
+// ======================================================================================
+// Submission
+// ======================================================================================
+
+static int
+uring_submit(uring_t *r, u32 min_complete, u32 flags, void *arg, size_t arg_size) {
+    u32 to_submit = r->sqe_tail - r->submitted;
+
+    __atomic_store_n(r->sq_tail, r->sqe_tail, __ATOMIC_RELEASE);
+    r->submitted = r->sqe_tail;
+
+    if (min_complete) {
+        flags |= IORING_ENTER_GETEVENTS;
+    } else if (!to_submit) {
+        return 0;
+    }
+
+    r->enters++;
+    return sys_enter(r->fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+// next free sqe, flushes queue to kernel if it is full
+struct io_uring_sqe *
+uring_get_sqe(uring_t *r) {
+    if (r->sqe_tail - __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE) >= r->sq_entries) {
+        uring_submit(r, 0, 0, NULL, 0);
+    }
+
+    struct io_uring_sqe *sqe = &r->sqes[r->sqe_tail & r->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sqe_tail++;
+
+    return sqe;
+}
+
+void
+uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, u32 len, u64 user_data) {
+    sqe->opcode    = IORING_OP_SEND;
+    sqe->fd        = fd;
+    sqe->addr      = (u64)(unsigned long)buf;
+    sqe->len       = len;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = user_data;
+}
+
+// stays armed until error, EOF or running out of provided buffers (no IORING_CQE_F_MORE in cqe)
+void
+uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, u64 user_data) {
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = fd;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUF_GROUP;
+    sqe->user_data = user_data;
+}
+
+// one shot, completes when fd gets any of events (used to learn that connect finished)
+void
+uring_prep_poll(struct io_uring_sqe *sqe, int fd, u32 events, u64 user_data) {
+    sqe->opcode        = IORING_OP_POLL_ADD;
+    sqe->fd            = fd;
+    sqe->poll32_events = events;
+    sqe->user_data     = user_data;
+}
+
+void
+uring_prep_cancel(struct io_uring_sqe *sqe, u64 target, u64 user_data) {
+    sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+    sqe->fd        = -1;
+    sqe->addr      = target;
+    sqe->user_data = user_data;
+}
+
+// submit everything prepared and wait for at least one completion, but not past deadline
+int
+uring_submit_and_wait(uring_t *r, u64 deadline_us) {
+    u64 now = now_us();
+
+    // something is ready already or nothing to wait for
+    if (*r->cq_head != __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE) || deadline_us <= now) {
+        return uring_submit(r, 0, 0, NULL, 0) < 0 ? RC_ERROR : RC_SUCCESS;
+    }
+
+    u64 wait_us = deadline_us - now;
+
+    struct __kernel_timespec ts = {
+      .tv_sec  = wait_us / 1000000,
+      .tv_nsec = (wait_us % 1000000) * 1000,
+    };
+    struct io_uring_getevents_arg arg = {
+      .sigmask    = 0,
+      .sigmask_sz = _NSIG / 8,
+      .ts         = (u64)(unsigned long)&ts,
+    };
+
+    int rc = uring_submit(r, 1, IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    if (rc < 0 && errno != ETIME && errno != EINTR) {
+        return RC_ERROR;
+    }
+
+    return RC_SUCCESS;
+}
+
+// ======================================================================================
+// Completion
+// ======================================================================================
+
+int
+uring_peek_cqe(uring_t *r, struct io_uring_cqe **cqe) {
+    u32 head = *r->cq_head;
+    if (head == __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE)) {
+        return RC_FAIL;
+    }
+
+    *cqe = &r->cqes[head & r->cq_mask];
+    return RC_SUCCESS;
+}
+
+void
+uring_cqe_seen(uring_t *r) {
+    __atomic_store_n(r->cq_head, *r->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+u8 *
+uring_buf(uring_t *r, u16 bid) {
+    return &r->bufs[(u32)bid * URING_BUF_LEN];
+}
+
+// give buffer back to kernel once its data is consumed
+void
+uring_buf_recycle(uring_t *r, u16 bid) {
+    struct io_uring_buf *buf = &r->br->bufs[r->br_tail & (URING_BUF_COUNT - 1)];
+
+    buf->addr = (u64)(unsigned long)uring_buf(r, bid);
+    buf->len  = URING_BUF_LEN;
+    buf->bid  = bid;
+
+    r->br_tail++;
+    __atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+}
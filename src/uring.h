@@ -0,0 +1,62 @@
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+
+#include "types.h"
+
+#define URING_ENTRIES   1024
+#define URING_BUF_COUNT 256 // power of 2, buffers provided to kernel for multishot receive
+#define URING_BUF_LEN   1024
+#define URING_BUF_GROUP 0
+
+// minimal io_uring over raw syscalls, one per thread
+typedef struct uring {
+    int fd;
+
+    // submission queue
+    u32                 *sq_head;
+    u32                 *sq_tail;
+    u32                  sq_mask;
+    u32                  sq_entries;
+    u32                  sqe_tail;  // sqes prepared so far, kernel sees them on submit
+    u32                  submitted; // sqe_tail at the last submit
+    struct io_uring_sqe *sqes;
+
+    // completion queue
+    u32                 *cq_head;
+    u32                 *cq_tail;
+    u32                  cq_mask;
+    struct io_uring_cqe *cqes;
+
+    // ring of buffers kernel picks from for receive
+    struct io_uring_buf_ring *br;
+    u8                       *bufs;
+    u16                       br_tail;
+
+    void  *sq_ptr;
+    void  *cq_ptr;
+    size_t sq_size;
+    size_t cq_size;
+    size_t sqes_size;
+
+    u64 enters; // io_uring_enter calls made
+} uring_t;
+
+int  uring_init(uring_t *r);
+void uring_free(uring_t *r);
+
+struct io_uring_sqe *uring_get_sqe(uring_t *r);
+void                 uring_prep_send(struct io_uring_sqe *sqe, int fd, const void *buf, u32 len, u64 user_data);
+void                 uring_prep_recv_multishot(struct io_uring_sqe *sqe, int fd, u64 user_data);
+void                 uring_prep_poll(struct io_uring_sqe *sqe, int fd, u32 events, u64 user_data);
+void                 uring_prep_cancel(struct io_uring_sqe *sqe, u64 target, u64 user_data);
+
+int  uring_submit_and_wait(uring_t *r, u64 deadline_us);
+int  uring_peek_cqe(uring_t *r, struct io_uring_cqe **cqe);
+void uring_cqe_seen(uring_t *r);
+
+u8  *uring_buf(uring_t *r, u16 bid);
+void uring_buf_recycle(uring_t *r, u16 bid);
+
+#endif